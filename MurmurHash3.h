@@ -32,6 +32,14 @@ void MurmurHash3_x86_128 ( const void * key, int len, uint32_t seed, void * out
 
 void MurmurHash3_x64_128 ( const void * key, int len, uint32_t seed, void * out );
 
+//-----------------------------------------------------------------------------
+// First 64-bit half of MurmurHash3_x64_128 of one key under MURMUR_LANES seeds
+// at once, vectorized across seeds
+
+#define MURMUR_LANES 8
+
+void MurmurHash3_x64_64_lanes ( const void * key, int len, const uint32_t * seeds, uint64_t * out );
+
 //-----------------------------------------------------------------------------
 
 #endif // _MURMURHASH3_H_
@@ -0,0 +1,284 @@
+#include "sparsehash.h"
+#include "simd.h"
+
+
+// Bytes of the two sets of sketches compared by a tile, L2-sized
+#define ALLPAIRS_TILE_BYTES 262144
+
+// Bytes of output held in memory when streaming
+#define ALLPAIRS_BLOCK_BYTES 67108864
+
+
+typedef struct{
+
+	const char *sketches;
+	uint32_t num_sketches;
+	uint32_t bit_len;
+	uint32_t stride;
+	sparsehash_measure_t measure;
+	uint32_t *ones;		// ones of every sketch
+	double *lnz;		// log of the zeros of every sketch
+	double *logtab;		// log(k) for k = 0 to bit_len
+	uint32_t tile;		// sketches per tile
+
+} allpairs_t;
+
+// Receives rows first to last-1 of the upper triangle, stored contiguously in rows
+typedef int (*allpairs_emit_t)(void *arg, const allpairs_t *ap, uint32_t first, uint32_t last, double *rows);
+
+
+// Position of row i in the packed upper triangle
+static inline uint64_t allpairs_row(uint64_t i, uint64_t n){
+
+	return i*(n-1) - i*(i-1)/2;
+
+}
+
+
+// Ones of a|b over the bit_len bits of the sketches
+static inline uint32_t allpairs_union(const allpairs_t *ap, const char *a, const char *b){
+
+	uint32_t byte_len = ap->bit_len/8, extra_bits = ap->bit_len%8;
+	uint32_t ones;
+
+
+	ones = simd_popcount_union((const uint8_t*)a, (const uint8_t*)b, byte_len);
+	if (extra_bits!=0)
+		ones += __builtin_popcount( (uint8_t)((a[byte_len] | b[byte_len]) & ~(0xFF >> extra_bits)) );
+
+	return ones;
+
+}
+
+
+// Compare sketches [row_first, row_last) with [col_first, col_last), upper triangle only.
+// rows holds the block of rows starting at block_first
+static void allpairs_tile(const allpairs_t *ap, uint32_t row_first, uint32_t row_last, uint32_t col_first, uint32_t col_last, uint32_t block_first, double *rows, uint32_t *unions){
+
+	uint32_t i, j, first, n;
+	const char *a;
+	double *out;
+
+
+	for (i=row_first; i<row_last; ++i){
+
+		first = (col_first > i+1) ? col_first : i+1;
+		if (first >= col_last)
+			continue;
+		n = col_last - first;
+		a = ap->sketches + (size_t)i*ap->stride;
+		out = rows + (allpairs_row(i, ap->num_sketches) - allpairs_row(block_first, ap->num_sketches)) + (first-i-1);
+
+		for (j=0; j<n; ++j)
+			unions[j] = allpairs_union(ap, a, ap->sketches + (size_t)(first+j)*ap->stride);
+
+		if (ap->measure == SPARSEHASH_MEASURE_JACCARD){
+			for (j=0; j<n; ++j)
+				unions[j] = ap->bit_len - unions[j];
+			simd_jaccard_row(unions, n, ap->lnz[i], ap->lnz+first, ap->logtab, ap->logtab[ap->bit_len], out);
+		}
+		else{
+			// |a^b| = 2|a|b| - |a| - |b|
+			for (j=0; j<n; ++j)
+				out[j] = 2.0*unions[j] - ap->ones[i] - ap->ones[first+j];
+		}
+
+	}
+
+}
+
+
+// Compute the upper triangle in blocks of rows, in place in matrix if given, handing every block to emit
+static int allpairs_run(const char *sketches, uint32_t num_sketches, uint32_t bit_len, sparsehash_measure_t measure, double *matrix, allpairs_emit_t emit, void *arg){
+
+	allpairs_t ap;
+	uint32_t i, block, first, last, num_tiles;
+	uint64_t block_entries;
+	double *rows = NULL;
+	int ret = 0, failed = 0;
+
+
+	if (num_sketches < 2)
+		return 0;
+
+	ap.sketches = sketches;
+	ap.num_sketches = num_sketches;
+	ap.bit_len = bit_len;
+	ap.stride = (bit_len+7)/8;
+	ap.measure = measure;
+	ap.tile = ALLPAIRS_TILE_BYTES/(2*ap.stride);
+	if (ap.tile == 0)
+		ap.tile = 1;
+
+	ap.ones = (uint32_t*) malloc(sizeof(uint32_t)*num_sketches);
+	ap.lnz = (double*) malloc(sizeof(double)*num_sketches);
+	ap.logtab = (double*) malloc(sizeof(double)*((size_t)bit_len+1));
+	if (ap.ones == NULL || ap.lnz == NULL || ap.logtab == NULL){
+		ret = -1;
+		goto done;
+	}
+
+	#pragma omp parallel for private(i)
+	for (i=0; i<=bit_len; ++i)
+		ap.logtab[i] = log((double)i);
+
+	#pragma omp parallel for private(i)
+	for (i=0; i<num_sketches; ++i){
+		ap.ones[i] = allpairs_union(&ap, sketches + (size_t)i*ap.stride, sketches + (size_t)i*ap.stride);
+		ap.lnz[i] = ap.logtab[bit_len - ap.ones[i]];
+	}
+
+	// Rows per block, whole row tiles unless a single tile of rows is over the budget
+	block = ALLPAIRS_BLOCK_BYTES/(sizeof(double)*num_sketches);
+	if (block > ap.tile)
+		block -= block % ap.tile;
+	if (block == 0)
+		block = 1;
+	if (block > num_sketches-1)
+		block = num_sketches-1;
+
+	if (matrix == NULL){
+		block_entries = allpairs_row(block, num_sketches);
+		rows = (double*) malloc(sizeof(double)*block_entries);
+		if (rows == NULL){
+			ret = -1;
+			goto done;
+		}
+	}
+
+	num_tiles = (num_sketches + ap.tile - 1)/ap.tile;
+
+	for (first=0; first<num_sketches-1 && ret==0; first=last){
+
+		uint32_t row_tiles, rt, ct;
+		double *dest;
+
+		last = (num_sketches-1-first > block) ? first+block : num_sketches-1;
+		row_tiles = (last - first + ap.tile - 1)/ap.tile;
+		dest = (matrix != NULL) ? matrix + allpairs_row(first, num_sketches) : rows;
+
+		#pragma omp parallel private(rt, ct)
+		{
+
+			uint32_t *unions = (uint32_t*) malloc(sizeof(uint32_t)*ap.tile);
+			uint32_t row_first, row_last, col_first, col_last;
+
+			if (unions == NULL){
+				#pragma omp atomic write
+				failed = 1;
+			}
+
+			// Every thread reaches the loop, the ones without a buffer only skip their tiles
+			#pragma omp for collapse(2) schedule(dynamic,1)
+			for (rt=0; rt<row_tiles; ++rt){
+				for (ct=0; ct<num_tiles; ++ct){
+					if (unions == NULL)
+						continue;
+					row_first = first + rt*ap.tile;
+					row_last = (row_first + ap.tile < last) ? row_first + ap.tile : last;
+					col_first = ct*ap.tile;
+					col_last = (col_first + ap.tile < num_sketches) ? col_first + ap.tile : num_sketches;
+					// Tiles below the diagonal are empty
+					if (col_last > row_first+1)
+						allpairs_tile(&ap, row_first, row_last, col_first, col_last, first, dest, unions);
+				}
+			}
+
+			free(unions);
+
+		}
+
+		if (failed)
+			ret = -1;
+		else if (emit != NULL)
+			ret = emit(arg, &ap, first, last, dest);
+
+	}
+
+done:
+	free(rows);
+	free(ap.ones);
+	free(ap.lnz);
+	free(ap.logtab);
+
+	return ret;
+
+}
+
+
+static int allpairs_emit_write(void *arg, const allpairs_t *ap, uint32_t first, uint32_t last, double *rows){
+
+	uint64_t entries = allpairs_row(last, ap->num_sketches) - allpairs_row(first, ap->num_sketches);
+
+
+	return (fwrite(rows, sizeof(double), entries, (FILE*)arg) == entries) ? 0 : -1;
+
+}
+
+
+typedef struct{
+
+	FILE *fp;
+	double threshold;
+	int64_t num_pairs;
+
+} allpairs_threshold_t;
+
+
+static int allpairs_emit_threshold(void *arg, const allpairs_t *ap, uint32_t first, uint32_t last, double *rows){
+
+	allpairs_threshold_t *th = (allpairs_threshold_t*)arg;
+	sparsehash_pair_t pair;
+	uint32_t i, j;
+	int keep;
+
+
+	for (i=first; i<last; ++i){
+		for (j=i+1; j<ap->num_sketches; ++j){
+			keep = (ap->measure == SPARSEHASH_MEASURE_JACCARD) ? (*rows >= th->threshold) : (*rows <= th->threshold);
+			if (keep){
+				pair.i = i;
+				pair.j = j;
+				pair.value = *rows;
+				if (fwrite(&pair, sizeof(sparsehash_pair_t), 1, th->fp) != 1)
+					return -1;
+				th->num_pairs++;
+			}
+			rows++;
+		}
+	}
+
+	return 0;
+
+}
+
+
+int sparsehash_allpairs(const char *sketches, uint32_t num_sketches, uint32_t bit_len, sparsehash_measure_t measure, double *matrix){
+
+	return allpairs_run(sketches, num_sketches, bit_len, measure, matrix, NULL, NULL);
+
+}
+
+
+int sparsehash_allpairs_write(const char *sketches, uint32_t num_sketches, uint32_t bit_len, sparsehash_measure_t measure, FILE *fp){
+
+	return allpairs_run(sketches, num_sketches, bit_len, measure, NULL, allpairs_emit_write, fp);
+
+}
+
+
+int64_t sparsehash_allpairs_threshold(const char *sketches, uint32_t num_sketches, uint32_t bit_len, sparsehash_measure_t measure, double threshold, FILE *fp){
+
+	allpairs_threshold_t th;
+
+
+	th.fp = fp;
+	th.threshold = threshold;
+	th.num_pairs = 0;
+
+	if (allpairs_run(sketches, num_sketches, bit_len, measure, NULL, allpairs_emit_threshold, &th) != 0)
+		return -1;
+
+	return th.num_pairs;
+
+}
@@ -0,0 +1,482 @@
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "sparsehash.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+#define AUTO_MAGIC "sparsehash-auto"
+#define AUTO_VERSION 2
+
+// Elements hashed by the calibration runs
+#define AUTO_CALIB_N 65536
+
+// Elements sampled for the mean string length
+#define AUTO_LEN_SAMPLE 1024
+
+// Elements of the lookup of one thread of the fast version, as FAST_PARALLEL_MIN of kernels.cpp
+#define AUTO_FAST_PARALLEL_MIN 16384
+
+// Expected elements until all of a block of k measurements are hit, harmonic numbers H_k times 1/gamma,
+// for the blocks of MURMUR_LANES measurements of the exact version and 64 of the medium one
+#define AUTO_REACH_EXACT 2.718
+#define AUTO_REACH_MEDIUM 4.744
+
+// Calibration gamma, small enough for no measurement to be hit, so that every element is compared with every measurement
+#define AUTO_CALIB_GAMMA 1e-12
+
+
+// Costs in seconds of the operations of the model, on one thread
+typedef struct{
+
+	double hash_int;	// hash of an integer
+	double hash_str;	// hash of a string, plus hash_byte per byte
+	double hash_byte;
+	double exact_int;	// element hashed against a block of MURMUR_LANES measurements
+	double exact_str;
+	double exact_byte;
+	double exact_block;	// block of MURMUR_LANES measurements
+	double search_8;	// search of the fast version in 2^8 intervals, in cache
+	double search_16;	// search in 2^16 intervals, deeper levels miss the caches
+	double window;		// element and interval compared by the medium version
+	double sort;		// interval and level of the sort of the bottoms
+	double tree;		// interval of the search tree
+	double region;		// parallel region with all the threads
+
+} auto_model_t;
+
+
+static auto_model_t model;
+static int model_ready = 0;
+
+
+static double auto_now(void){
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+
+}
+
+
+static double nonneg(double x){
+	return (x > 0) ? x : 0;
+}
+
+
+// Fastest of 3 sketches of data with a plan of m bits, or of 3 plan creations if data is NULL. -1 if out of memory
+static double auto_time(sparsehash_variant_t variant, uint32_t m, void *data, uint32_t num_elements, uint16_t element_size, uint16_t *str_len){
+
+	sparsehash_plan_t *plan = NULL, *created;
+	double best = 1e300, start, t;
+	char *out = NULL;
+	int r, ok;
+
+
+	if (data != NULL){
+		plan = sparsehash_plan_create(1, AUTO_CALIB_GAMMA, m, variant);
+		if (plan != NULL)
+			out = (char*) malloc(plan->mbytes);
+		if (plan == NULL || out == NULL){
+			sparsehash_plan_destroy(plan);
+			return -1;
+		}
+	}
+
+	for (r=0; r<3; ++r){
+		start = auto_now();
+		if (data != NULL)
+			ok = (sparsehash_sketch_with_plan(plan, data, num_elements, element_size, str_len, out) == 0);
+		else{
+			created = sparsehash_plan_create(1, AUTO_CALIB_GAMMA, m, variant);
+			ok = (created != NULL);
+			sparsehash_plan_destroy(created);
+		}
+		t = auto_now() - start;
+		if (!ok){
+			best = -1;
+			break;
+		}
+		if (t < best)
+			best = t;
+	}
+
+	free(out);
+	sparsehash_plan_destroy(plan);
+
+	return best;
+
+}
+
+
+// Time each term of the model with no hits, integers and strings of two lengths. -1 if out of memory, c is then not set
+static int auto_measure(auto_model_t *c){
+
+	const uint32_t n = AUTO_CALIB_N, ne = AUTO_CALIB_N/4;
+	uint32_t *ints, i;
+	char **strings, *chars;
+	uint16_t *len8, *len64;
+	double h, s8, s64, f8, f16, x, e8, e64, xb, w, t1, t2, region, start;
+	int r, ok, threads = 1, cores;
+
+
+	ints = (uint32_t*) malloc(sizeof(uint32_t)*n);
+	strings = (char**) malloc(sizeof(char*)*n);
+	chars = (char*) malloc((size_t)64*n);
+	len8 = (uint16_t*) malloc(sizeof(uint16_t)*n);
+	len64 = (uint16_t*) malloc(sizeof(uint16_t)*n);
+	if (ints == NULL || strings == NULL || chars == NULL || len8 == NULL || len64 == NULL){
+		free(ints); free(strings); free(chars); free(len8); free(len64);
+		return -1;
+	}
+
+	for (i=0; i<n; ++i){
+		ints[i] = i*2654435761u;
+		strings[i] = chars + (size_t)64*i;
+		len8[i] = 8;
+		len64[i] = 64;
+	}
+	for (i=0; i<64*n; ++i)
+		chars[i] = (char)(i*131 + i/64);
+
+	// Parallel regions with a thread per core, then the rest on one thread
+	cores = sysconf(_SC_NPROCESSORS_ONLN);
+	start = auto_now();
+	for (r=0; r<1000; ++r){
+		#pragma omp parallel num_threads(cores)
+		{
+		}
+	}
+	region = (cores > 1) ? (auto_now() - start)/1000 : 0;
+#ifdef _OPENMP
+	threads = omp_get_max_threads();
+	omp_set_num_threads(1);
+#endif
+
+	// Hashes, the medium version with one interval does little else
+	h = auto_time(SPARSEHASH_MEDIUM, 1, ints, n, 4, NULL);
+	s8 = auto_time(SPARSEHASH_MEDIUM, 1, strings, n, 1, len8);
+	s64 = auto_time(SPARSEHASH_MEDIUM, 1, strings, n, 1, len64);
+	// Fast version with 2^8 and 2^16 intervals
+	f8 = auto_time(SPARSEHASH_FAST, 1 << 8, ints, n, 4, NULL);
+	f16 = auto_time(SPARSEHASH_FAST, 1 << 16, ints, n, 4, NULL);
+	// Exact version with 8 blocks of measurements, and 2^11 blocks with one element
+	x = auto_time(SPARSEHASH_EXACT, 8*MURMUR_LANES, ints, ne, 4, NULL);
+	e8 = auto_time(SPARSEHASH_EXACT, 8*MURMUR_LANES, strings, ne, 1, len8);
+	e64 = auto_time(SPARSEHASH_EXACT, 8*MURMUR_LANES, strings, ne, 1, len64);
+	xb = auto_time(SPARSEHASH_EXACT, 2048*MURMUR_LANES, ints, 1, 4, NULL);
+	// Medium version with 1024 intervals, every hash against every interval
+	w = auto_time(SPARSEHASH_MEDIUM, 1024, ints, n, 4, NULL);
+	// Plans of 2^16 intervals, sorted, and sorted with a tree
+	t1 = auto_time(SPARSEHASH_MEDIUM, 1 << 16, NULL, 0, 0, NULL);
+	t2 = auto_time(SPARSEHASH_FAST, 1 << 16, NULL, 0, 0, NULL);
+
+#ifdef _OPENMP
+	omp_set_num_threads(threads);
+#endif
+
+	free(ints); free(strings); free(chars); free(len8); free(len64);
+
+	ok = h >= 0 && s8 >= 0 && s64 >= 0 && f8 >= 0 && f16 >= 0 && x >= 0 && e8 >= 0 && e64 >= 0 && xb >= 0 && w >= 0 && t1 >= 0 && t2 >= 0;
+	if (!ok)
+		return -1;
+
+	c->region = region;
+	c->hash_int = h/n;
+	c->hash_byte = nonneg((s64-s8)/(56.0*n));
+	c->hash_str = nonneg(s8/n - 8*c->hash_byte);
+	c->search_8 = nonneg(f8/n - c->hash_int);
+	c->search_16 = nonneg(f16/n - c->hash_int);
+	c->exact_int = x/(8.0*ne);
+	c->exact_byte = nonneg((e64-e8)/(56.0*8*ne));
+	c->exact_str = nonneg(e8/(8.0*ne) - 8*c->exact_byte);
+	c->exact_block = nonneg(xb/2048 - c->exact_int);
+	c->window = nonneg((w - c->hash_int*n)/(1024.0*n));
+	c->sort = t1/(16.0*(1 << 16));
+	c->tree = nonneg((t2-t1)/(1 << 16));
+
+	return 0;
+
+}
+
+
+// Host line of the cache, a calibration is only valid on the host and core count that made it
+static void auto_host(char *host, size_t size, long *cores){
+
+	if (gethostname(host, size) != 0 || host[0] == '\0')
+		snprintf(host, size, "unknown");
+	host[size-1] = '\0';
+	*cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+}
+
+
+// Default cache file, creating its directory. 0 if there is one
+static int auto_default_path(char *path, size_t size){
+
+	const char *env, *home;
+	char host[256], dir[2048];
+	long cores;
+
+
+	env = getenv("SPARSEHASH_CALIBRATION");
+	if (env != NULL){
+		snprintf(path, size, "%s", env);
+		return 0;
+	}
+
+	home = getenv("HOME");
+	if (home == NULL)
+		return -1;
+
+	auto_host(host, sizeof(host), &cores);
+	snprintf(dir, sizeof(dir), "%s/.cache", home);
+	mkdir(dir, 0755);
+	snprintf(dir, sizeof(dir), "%s/.cache/sparsehash", home);
+	if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+		return -1;
+	snprintf(path, size, "%s/calibration-%s", dir, host);
+
+	return 0;
+
+}
+
+
+static int auto_save(const auto_model_t *c, const char *path){
+
+	char host[256];
+	long cores;
+	FILE *fp;
+	int ok;
+
+
+	fp = fopen(path, "w");
+	if (fp == NULL)
+		return -1;
+
+	auto_host(host, sizeof(host), &cores);
+	ok = fprintf(fp, "%s %d %s %ld\n", AUTO_MAGIC, AUTO_VERSION, host, cores) > 0;
+	ok = ok && fprintf(fp, "%.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g\n",
+					   c->hash_int, c->hash_str, c->hash_byte, c->exact_int, c->exact_str, c->exact_byte, c->exact_block,
+					   c->search_8, c->search_16, c->window, c->sort, c->tree, c->region) > 0;
+
+	if (fclose(fp) != 0 || !ok)
+		return -1;
+
+	return 0;
+
+}
+
+
+static int auto_load(auto_model_t *c, const char *path){
+
+	char magic[32], host[256], saved[256];
+	long cores, saved_cores;
+	int version, ok;
+	FILE *fp;
+
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return -1;
+
+	auto_host(host, sizeof(host), &cores);
+	ok = fscanf(fp, "%31s %d %255s %ld", magic, &version, saved, &saved_cores) == 4
+		 && strcmp(magic, AUTO_MAGIC) == 0 && version == AUTO_VERSION && strcmp(saved, host) == 0 && saved_cores == cores
+		 && fscanf(fp, "%lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf", &c->hash_int, &c->hash_str, &c->hash_byte, &c->exact_int,
+				   &c->exact_str, &c->exact_byte, &c->exact_block, &c->search_8, &c->search_16, &c->window, &c->sort, &c->tree, &c->region) == 13;
+
+	fclose(fp);
+
+	return ok ? 0 : -1;
+
+}
+
+
+// Model of the first call, from the cache or calibrated and cached. -1 if the calibration failed, nothing is cached
+// then and the next call tries again
+static int auto_model(auto_model_t *c){
+
+	char path[4096];
+	int has_path, ret = 0;
+
+
+	#pragma omp critical(sparsehash_auto)
+	{
+		if (!model_ready){
+			has_path = (auto_default_path(path, sizeof(path)) == 0);
+			if (has_path && auto_load(&model, path) == 0)
+				model_ready = 1;
+			else if (auto_measure(&model) == 0){
+				if (has_path)
+					auto_save(&model, path);
+				model_ready = 1;
+			}
+		}
+		if (model_ready)
+			*c = model;
+		else
+			ret = -1;
+	}
+
+	return ret;
+
+}
+
+
+int sparsehash_auto_calibrate(const char *path){
+
+	auto_model_t c;
+	char def[4096];
+
+
+	if (auto_measure(&c) != 0)
+		return -1;
+
+	#pragma omp critical(sparsehash_auto)
+	{
+		model = c;
+		model_ready = 1;
+	}
+
+	if (path == NULL){
+		if (auto_default_path(def, sizeof(def)) != 0)
+			return -1;
+		path = def;
+	}
+
+	return auto_save(&c, path);
+
+}
+
+
+// Predicted seconds of a sketch with a new plan on threads threads
+static double auto_predict(const auto_model_t *c, sparsehash_variant_t variant, uint32_t n, double len, double gamma, uint32_t m, int threads){
+
+	double hash, exact, reach, levels, search, blocks, par, lookup_threads;
+
+
+	hash = (len > 0) ? c->hash_str + len*c->hash_byte : c->hash_int;
+	exact = (len > 0) ? c->exact_str + len*c->exact_byte : c->exact_int;
+	levels = log2((double)m+1);
+	// Linear in the levels up to 2^8 intervals, then along the slope measured up to 2^16
+	search = (levels <= 8) ? c->search_8*levels/8 : c->search_8 + (levels-8)*(c->search_16-c->search_8)/8;
+	par = (threads > 1) ? c->region : 0;
+
+	switch (variant){
+
+		case SPARSEHASH_EXACT :
+			blocks = ceil((double)m/MURMUR_LANES);
+			reach = (gamma > 0 && AUTO_REACH_EXACT/gamma < n) ? AUTO_REACH_EXACT/gamma : n;
+			return (exact*reach + c->exact_block)*blocks/fmin(threads, blocks) + par;
+
+		case SPARSEHASH_MEDIUM :
+			blocks = ceil(m/64.0);
+			reach = (gamma > 0 && AUTO_REACH_MEDIUM/gamma < n) ? AUTO_REACH_MEDIUM/gamma : n;
+			return c->sort*m*levels + hash*n/threads + c->window*m*reach/fmin(threads, blocks) + 2*par;
+
+		case SPARSEHASH_FAST :
+			lookup_threads = fmax(1, fmin(threads, floor((double)n/AUTO_FAST_PARALLEL_MIN)));
+			return c->sort*m*levels + c->tree*m + hash*n/threads + search*n/lookup_threads + ((lookup_threads > 1) ? 2 : 1)*par;
+
+	}
+
+	return 1e300;
+
+}
+
+
+void sparsehash_auto_choose(uint32_t num_elements, uint16_t element_size, const uint16_t *str_len, double gamma, uint32_t m, sparsehash_variant_t reference, sparsehash_auto_choice_t *choice){
+
+	auto_model_t c;
+	double len = 0, t;
+	uint32_t i, sample;
+	int v, threads, max_threads = 1;
+
+
+	// Mean length of the first strings
+	if (element_size == 1 && str_len != NULL && num_elements > 0){
+		sample = (num_elements < AUTO_LEN_SAMPLE) ? num_elements : AUTO_LEN_SAMPLE;
+		for (i=0; i<sample; ++i)
+			len += str_len[i];
+		len = fmax(len/sample, 1);
+	}
+
+	// Nested regions run on one thread, more threads than cores only add switches
+#ifdef _OPENMP
+	if (!omp_in_parallel())
+		max_threads = omp_get_max_threads();
+#endif
+	if (max_threads > sysconf(_SC_NPROCESSORS_ONLN))
+		max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (max_threads < 1)
+		max_threads = 1;
+
+	// With no model, the fast version or the exact one, whichever reference allows, on all the threads
+	choice->variant = (reference == SPARSEHASH_EXACT) ? SPARSEHASH_EXACT : SPARSEHASH_FAST;
+	choice->threads = max_threads;
+	choice->seconds = -1;
+	if (auto_model(&c) != 0)
+		return;
+	choice->seconds = 1e300;
+
+	for (v=SPARSEHASH_EXACT; v<=SPARSEHASH_FAST; ++v){
+
+		// Only variants whose sketches can be compared with those of reference
+		if ((reference == SPARSEHASH_EXACT) != (v == SPARSEHASH_EXACT))
+			continue;
+
+		// Powers of two and all the threads
+		for (threads=1; ; threads*=2){
+			if (threads > max_threads)
+				threads = max_threads;
+			t = auto_predict(&c, (sparsehash_variant_t)v, num_elements, len, gamma, m, threads);
+			if (t < choice->seconds){
+				choice->variant = (sparsehash_variant_t)v;
+				choice->threads = threads;
+				choice->seconds = t;
+			}
+			if (threads == max_threads)
+				break;
+		}
+
+	}
+
+}
+
+
+int sparsehash_sketch_auto(void *data, uint32_t num_elements, uint16_t element_size, uint16_t *str_len, uint32_t seed, double gamma, uint32_t m, sparsehash_variant_t reference, sparsehash_auto_choice_t *chosen, char *out){
+
+	sparsehash_auto_choice_t choice;
+	sparsehash_plan_t *plan;
+	int ret = -1;
+#ifdef _OPENMP
+	int saved = omp_get_max_threads();
+#endif
+
+
+	sparsehash_auto_choose(num_elements, element_size, str_len, gamma, m, reference, &choice);
+	if (chosen != NULL)
+		*chosen = choice;
+
+#ifdef _OPENMP
+	omp_set_num_threads(choice.threads);
+#endif
+
+	plan = sparsehash_plan_create(seed, gamma, m, choice.variant);
+	if (plan != NULL){
+		ret = sparsehash_sketch_with_plan(plan, data, num_elements, element_size, str_len, out);
+		sparsehash_plan_destroy(plan);
+	}
+
+#ifdef _OPENMP
+	omp_set_num_threads(saved);
+#endif
+
+	return ret;
+
+}
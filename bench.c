@@ -0,0 +1,502 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "sparsehash.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+#define MAX_LIST 16
+
+// Most repetitions of one configuration
+#define MAX_REPS 1000
+
+// Comparisons timed together, single comparisons are too short for the clock
+#define COMPARE_BATCH 4096
+
+// Sketches compared in the comparison benchmark
+#define COMPARE_SKETCHES 1024
+
+
+typedef struct{
+
+	uint32_t n[MAX_LIST], num_n;
+	uint32_t m[MAX_LIST], num_m;
+	double gamma[MAX_LIST];
+	uint32_t num_gamma;
+	uint32_t element_size[MAX_LIST], num_element_size;
+	uint32_t threads[MAX_LIST], num_threads;
+	uint32_t variants;			// bit v set for variant v
+	double min_time;			// seconds per configuration
+	double budget;				// largest n*m of the exact and medium variants
+	uint32_t seed;
+
+} bench_config_t;
+
+// Elements of one type, synthetic or from a file
+typedef struct{
+
+	void *data;
+	uint16_t *str_len;
+	uint32_t num_elements;
+	uint16_t element_size;
+
+} bench_data_t;
+
+
+static double now(void){
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+
+}
+
+
+static long peak_rss_kb(void){
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+
+}
+
+
+static int cmpdouble(const void *a, const void *b){
+
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+
+}
+
+
+// Comma-separated list of numbers. Number of entries, 0 if malformed
+static uint32_t parse_list(const char *arg, double *values){
+
+	uint32_t n = 0;
+	char *end;
+
+
+	while (*arg && n < MAX_LIST){
+		values[n++] = strtod(arg, &end);
+		if (end == arg)
+			return 0;
+		arg = (*end == ',') ? end+1 : end;
+	}
+
+	return n;
+
+}
+
+
+static uint32_t parse_uints(const char *arg, uint32_t *values){
+
+	double v[MAX_LIST];
+	uint32_t i, n = parse_list(arg, v);
+
+
+	for (i=0; i<n; ++i)
+		values[i] = (uint32_t)v[i];
+
+	return n;
+
+}
+
+
+// Random elements of element_size bytes, strings of 8 to 32 bytes for element_size 1
+static int synthetic_data(bench_data_t *d, uint32_t num_elements, uint16_t element_size, uint32_t seed){
+
+	uint64_t state = seed;
+	uint32_t i, j;
+	char **strings;
+	char *chars;
+
+
+	d->num_elements = num_elements;
+	d->element_size = element_size;
+	d->str_len = NULL;
+
+#define NEXT() (state = state*6364136223846793005ull + 1442695040888963407ull, state >> 33)
+
+	if (element_size == 1){
+		strings = (char**) malloc(sizeof(char*)*num_elements);
+		chars = (char*) malloc((size_t)32*num_elements);
+		d->str_len = (uint16_t*) malloc(sizeof(uint16_t)*num_elements);
+		if (strings == NULL || chars == NULL || d->str_len == NULL)
+			return -1;
+		for (i=0; i<num_elements; ++i){
+			strings[i] = chars + (size_t)32*i;
+			d->str_len[i] = 8 + NEXT()%25;
+			for (j=0; j<32; ++j)
+				strings[i][j] = (char)NEXT();
+		}
+		d->data = strings;
+	}
+	else{
+		d->data = malloc((size_t)element_size*num_elements);
+		if (d->data == NULL)
+			return -1;
+		for (i=0; i<(size_t)element_size*num_elements; ++i)
+			((uint8_t*)d->data)[i] = (uint8_t)NEXT();
+	}
+
+#undef NEXT
+
+	return 0;
+
+}
+
+
+static void free_data(bench_data_t *d){
+
+	if (d->element_size == 1 && d->data != NULL)
+		free(((char**)d->data)[0]);
+	free(d->data);
+	free(d->str_len);
+
+}
+
+
+// s as a JSON string, with quotes, backslashes and control characters escaped
+static void print_json_string(const char *s){
+
+	putchar('"');
+	for (; *s; ++s){
+		if (*s == '"' || *s == '\\')
+			printf("\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			printf("\\u%04x", (unsigned char)*s);
+		else
+			putchar(*s);
+	}
+	putchar('"');
+
+}
+
+
+// Time sketch of the first n elements of d, repeated for at least min_time seconds. 0 if successful, -1 otherwise
+static int bench_sketch(const bench_config_t *cfg, const bench_data_t *d, const char *source, sparsehash_variant_t variant, uint32_t n, uint32_t m, double gamma, uint32_t threads, int *first){
+
+	static const char *names[] = {"exact", "medium", "fast"};
+	sparsehash_plan_t *plan;
+	sparsehash_stats_t stats;
+	double lat[MAX_REPS], start, total = 0, t0;
+	uint32_t reps = 0;
+	char *out;
+
+
+#ifdef _OPENMP
+	omp_set_num_threads(threads);
+#endif
+
+	t0 = now();
+	plan = sparsehash_plan_create(cfg->seed, gamma, m, variant);
+	t0 = now() - t0;
+	out = (plan != NULL) ? (char*) malloc(plan->mbytes) : NULL;
+	if (out == NULL){
+		sparsehash_plan_destroy(plan);
+		return -1;
+	}
+
+	// One run to warm up caches and page in the plan
+	sparsehash_sketch_with_plan(plan, d->data, n, d->element_size, d->str_len, out);
+	sparsehash_stats_reset();
+
+	while (reps < MAX_REPS && (total < cfg->min_time || reps < 3)){
+		start = now();
+		sparsehash_sketch_with_plan(plan, d->data, n, d->element_size, d->str_len, out);
+		lat[reps] = now() - start;
+		total += lat[reps++];
+	}
+	qsort(lat, reps, sizeof(double), cmpdouble);
+
+	printf("%s    {\"bench\": \"sketch\", \"source\": ", *first ? "" : ",\n");
+	print_json_string(source);
+	printf(", \"variant\": \"%s\", \"n\": %u, \"m\": %u, \"gamma\": %.6g, \"element_size\": %u, \"threads\": %u, "
+		   "\"reps\": %u, \"plan_s\": %.6g, \"elements_per_s\": %.6g, \"latency_s\": {\"min\": %.6g, \"p50\": %.6g, \"p90\": %.6g, \"p99\": %.6g, \"max\": %.6g}, \"peak_rss_kb\": %ld",
+		   names[variant], n, m, gamma, d->element_size, threads,
+		   reps, t0, (double)n*reps/total, lat[0], lat[reps/2], lat[(reps*9)/10], lat[(reps*99)/100], lat[reps-1], peak_rss_kb());
+
+	// Counters of one sketch, with the library built with make STATS=1
+	if (sparsehash_stats_enabled()){
+		sparsehash_stats_get(&stats);
+		printf(", \"stats\": {\"hash_s\": %.6g, \"lookup_s\": %.6g, \"hashes\": %.6g, \"searches\": %.6g, \"nodes_visited\": %.6g, "
+			   "\"hits\": %.6g, \"overlap_scanned\": %.6g, \"windows\": %.6g, \"bits_set\": %.6g}",
+			   stats.phase_seconds[SPARSEHASH_PHASE_HASH]/reps, stats.phase_seconds[SPARSEHASH_PHASE_LOOKUP]/reps, (double)stats.hashes/reps,
+			   (double)stats.searches/reps, (double)stats.nodes_visited/reps, (double)stats.hits/reps, (double)stats.overlap_scanned/reps,
+			   (double)stats.windows/reps, (double)stats.bits_set/reps);
+	}
+	printf("}");
+	*first = 0;
+	fflush(stdout);
+
+	free(out);
+	sparsehash_plan_destroy(plan);
+
+	return 0;
+
+}
+
+
+// Time sparsehash_dist_H and sparsehash_sim_J between random sketches of m bits. 0 if successful, -1 otherwise
+static int bench_compare(const bench_config_t *cfg, uint32_t m, int *first){
+
+	static const char *names[] = {"dist_H", "sim_J"};
+	double lat[MAX_REPS], start, total, sink = 0;
+	uint32_t mbytes = (m+7)/8, reps, i, f;
+	uint64_t state = cfg->seed;
+	char *sketches;
+
+
+	sketches = (char*) malloc((size_t)mbytes*COMPARE_SKETCHES);
+	if (sketches == NULL)
+		return -1;
+	for (i=0; i<(size_t)mbytes*COMPARE_SKETCHES; ++i){
+		state = state*6364136223846793005ull + 1442695040888963407ull;
+		sketches[i] = (char)(state >> 56);
+	}
+
+	for (f=0; f<2; ++f){
+
+		reps = 0;
+		total = 0;
+		while (reps < MAX_REPS && (total < cfg->min_time || reps < 3)){
+			start = now();
+			for (i=0; i<COMPARE_BATCH; ++i){
+				const char *a = sketches + (size_t)(i % COMPARE_SKETCHES)*mbytes;
+				const char *b = sketches + (size_t)((i*7+1) % COMPARE_SKETCHES)*mbytes;
+				sink += (f == 0) ? sparsehash_dist_H(a, b, m) : sparsehash_sim_J(a, b, m);
+			}
+			lat[reps] = (now() - start)/COMPARE_BATCH;
+			total += lat[reps++]*COMPARE_BATCH;
+		}
+		qsort(lat, reps, sizeof(double), cmpdouble);
+
+		printf("%s    {\"bench\": \"%s\", \"m\": %u, \"reps\": %u, \"comparisons_per_s\": %.6g, "
+			   "\"latency_s\": {\"min\": %.6g, \"p50\": %.6g, \"p90\": %.6g, \"p99\": %.6g, \"max\": %.6g}, \"peak_rss_kb\": %ld}",
+			   *first ? "" : ",\n", names[f], m, reps, (double)COMPARE_BATCH*reps/total,
+			   lat[0], lat[reps/2], lat[(reps*9)/10], lat[(reps*99)/100], lat[reps-1], peak_rss_kb());
+		*first = 0;
+		fflush(stdout);
+
+	}
+
+	// Keeps the comparisons from being optimized away
+	if (sink == 1e300)
+		fprintf(stderr, "%g\n", sink);
+	free(sketches);
+
+	return 0;
+
+}
+
+
+static void usage(const char *name){
+
+	fprintf(stderr, "usage: %s [options]\n", name);
+	fprintf(stderr, "  -n list     set sizes (default 1000,100000,1000000)\n");
+	fprintf(stderr, "  -m list     sketch lengths (default 1000,10000,100000)\n");
+	fprintf(stderr, "  -g list     gammas (default get_gamma(n))\n");
+	fprintf(stderr, "  -e list     element sizes 1 (strings), 2, 4 or 8 (default 1,2,4)\n");
+	fprintf(stderr, "  -t list     threads (default 1 and all)\n");
+	fprintf(stderr, "  -v list     variants exact, medium, fast (default all)\n");
+	fprintf(stderr, "  -i file     also sketch the elements of file, read as -f format\n");
+	fprintf(stderr, "  -f format   lines, sets, u16, u32 or u64 (default lines)\n");
+	fprintf(stderr, "  -T seconds  time per configuration (default 0.2)\n");
+	fprintf(stderr, "  -B budget   skip exact and medium runs with n*m over budget (default 2e9)\n");
+	fprintf(stderr, "  -C          comparisons only\n");
+
+}
+
+
+// Sweep the configurations and print one JSON document on stdout
+int main(int argc, char *argv[]){
+
+	bench_config_t cfg;
+	bench_data_t d;
+	sparsehash_input_t *in = NULL;
+	sparsehash_format_t format = SPARSEHASH_INPUT_LINES;
+	const char *path = NULL;
+	uint32_t in_, im, ig, ie, it, v, n;
+	int opt, first = 1, compare_only = 0;
+	char *tok;
+	double gamma;
+
+
+	memset(&cfg, 0, sizeof(bench_config_t));
+	cfg.num_n = parse_uints("1000,100000,1000000", cfg.n);
+	cfg.num_m = parse_uints("1000,10000,100000", cfg.m);
+	cfg.num_element_size = parse_uints("1,2,4", cfg.element_size);
+	cfg.threads[0] = 1;
+	cfg.num_threads = 1;
+#ifdef _OPENMP
+	if (omp_get_max_threads() > 1)
+		cfg.threads[cfg.num_threads++] = omp_get_max_threads();
+#endif
+	cfg.variants = 7;
+	cfg.min_time = 0.2;
+	cfg.budget = 2e9;
+	cfg.seed = 1;
+
+	while ((opt = getopt(argc, argv, "n:m:g:e:t:v:i:f:T:B:Ch")) != -1){
+		switch (opt){
+
+			case 'n' : cfg.num_n = parse_uints(optarg, cfg.n); break;
+			case 'm' : cfg.num_m = parse_uints(optarg, cfg.m); break;
+			case 'g' : cfg.num_gamma = parse_list(optarg, cfg.gamma); break;
+			case 'e' : cfg.num_element_size = parse_uints(optarg, cfg.element_size); break;
+			case 't' : cfg.num_threads = parse_uints(optarg, cfg.threads); break;
+			case 'i' : path = optarg; break;
+			case 'T' : cfg.min_time = atof(optarg); break;
+			case 'B' : cfg.budget = atof(optarg); break;
+			case 'C' : compare_only = 1; break;
+
+			case 'v' :
+				cfg.variants = 0;
+				for (tok=strtok(optarg, ","); tok!=NULL; tok=strtok(NULL, ",")){
+					if (strcmp(tok, "exact") == 0) cfg.variants |= 1 << SPARSEHASH_EXACT;
+					else if (strcmp(tok, "medium") == 0) cfg.variants |= 1 << SPARSEHASH_MEDIUM;
+					else if (strcmp(tok, "fast") == 0) cfg.variants |= 1 << SPARSEHASH_FAST;
+					else{
+						fprintf(stderr, "unknown variant %s\n", tok);
+						usage(argv[0]);
+						return 1;
+					}
+				}
+				break;
+
+			case 'f' :
+				if (strcmp(optarg, "sets") == 0) format = SPARSEHASH_INPUT_SETS;
+				else if (strcmp(optarg, "u16") == 0) format = SPARSEHASH_INPUT_U16;
+				else if (strcmp(optarg, "u32") == 0) format = SPARSEHASH_INPUT_U32;
+				else if (strcmp(optarg, "u64") == 0) format = SPARSEHASH_INPUT_U64;
+				else if (strcmp(optarg, "lines") == 0) format = SPARSEHASH_INPUT_LINES;
+				else{
+					fprintf(stderr, "unknown format %s\n", optarg);
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			default :
+				usage(argv[0]);
+				return 1;
+
+		}
+	}
+
+	if (cfg.num_n == 0 || cfg.num_m == 0 || cfg.num_element_size == 0 || cfg.num_threads == 0 || cfg.variants == 0){
+		usage(argv[0]);
+		return 1;
+	}
+	for (im=0; im<cfg.num_m; ++im){
+		if (cfg.m[im] == 0){
+			fprintf(stderr, "sketch lengths must be positive\n");
+			return 1;
+		}
+	}
+	// Written as is in the JSON, so nan and inf are rejected too
+	for (ig=0; ig<cfg.num_gamma; ++ig){
+		if (!(cfg.gamma[ig] > 0 && cfg.gamma[ig] < 1)){
+			fprintf(stderr, "gammas must be between 0 and 1\n");
+			return 1;
+		}
+	}
+	for (it=0; it<cfg.num_threads; ++it){
+		if (cfg.threads[it] == 0){
+			fprintf(stderr, "thread counts must be positive\n");
+			return 1;
+		}
+	}
+	for (ie=0; ie<cfg.num_element_size; ++ie){
+		if (cfg.element_size[ie] != 1 && cfg.element_size[ie] != 2 && cfg.element_size[ie] != 4 && cfg.element_size[ie] != 8){
+			fprintf(stderr, "unknown element size %u\n", cfg.element_size[ie]);
+			return 1;
+		}
+	}
+
+	if (path != NULL){
+		in = sparsehash_input_map(path, format);
+		if (in == NULL){
+			fprintf(stderr, "cannot read %s\n", path);
+			return 1;
+		}
+	}
+
+	printf("{\n  \"max_threads\": %d,\n  \"results\": [\n",
+#ifdef _OPENMP
+		   omp_get_max_threads()
+#else
+		   1
+#endif
+		   );
+
+	for (im=0; im<cfg.num_m; ++im){
+		if (bench_compare(&cfg, cfg.m[im], &first) != 0){
+			fprintf(stderr, "out of memory comparing sketches of %u bits\n", cfg.m[im]);
+			return 1;
+		}
+	}
+
+	for (ie=0; ie<cfg.num_element_size + (in != NULL) && !compare_only; ++ie){
+
+		// The file, if any, after the synthetic element sizes. All its sets form one pool of elements
+		if (ie < cfg.num_element_size){
+			if (synthetic_data(&d, cfg.n[0], cfg.element_size[ie], cfg.seed) != 0){
+				fprintf(stderr, "out of memory generating %u elements\n", cfg.n[0]);
+				return 1;
+			}
+			for (in_=1; in_<cfg.num_n; ++in_){
+				if (cfg.n[in_] > d.num_elements){
+					free_data(&d);
+					if (synthetic_data(&d, cfg.n[in_], cfg.element_size[ie], cfg.seed) != 0){
+						fprintf(stderr, "out of memory generating %u elements\n", cfg.n[in_]);
+						return 1;
+					}
+				}
+			}
+		}
+		else{
+			d.data = in->data;
+			d.str_len = in->str_len;
+			d.element_size = in->element_size;
+			d.num_elements = (uint32_t)in->offsets[in->num_sets];
+		}
+
+		for (in_=0; in_<cfg.num_n; ++in_){
+			n = (cfg.n[in_] < d.num_elements) ? cfg.n[in_] : d.num_elements;
+			if (n == 0)
+				continue;
+			for (im=0; im<cfg.num_m; ++im){
+				for (ig=0; ig<(cfg.num_gamma > 0 ? cfg.num_gamma : 1); ++ig){
+					gamma = (cfg.num_gamma > 0) ? cfg.gamma[ig] : get_gamma(n);
+					for (v=0; v<3; ++v){
+						if (!(cfg.variants & (1 << v)) || (v != SPARSEHASH_FAST && (double)n*cfg.m[im] > cfg.budget))
+							continue;
+						for (it=0; it<cfg.num_threads; ++it){
+							if (bench_sketch(&cfg, &d, (ie < cfg.num_element_size) ? "synthetic" : path, (sparsehash_variant_t)v, n, cfg.m[im], gamma, cfg.threads[it], &first) != 0){
+								fprintf(stderr, "cannot create a plan of %u bits with gamma %g\n", cfg.m[im], gamma);
+								return 1;
+							}
+						}
+					}
+				}
+			}
+		}
+
+		if (ie < cfg.num_element_size)
+			free_data(&d);
+
+	}
+
+	printf("\n  ],\n  \"peak_rss_kb\": %ld\n}\n", peak_rss_kb());
+
+	sparsehash_input_unmap(in);
+
+	return 0;
+
+}
@@ -0,0 +1,343 @@
+#include "sparsehash.h"
+#include "simd.h"
+
+
+// Default prefix, m/CASCADE_PREFIX_DIV bits and at least CASCADE_MIN_PREFIX
+#define CASCADE_PREFIX_DIV 16
+#define CASCADE_MIN_PREFIX 512
+
+// Growth of the compared prefix at each stage
+#define CASCADE_GROWTH 4
+
+
+// Sketch in prefix order, bytes below split in pre and the others in suf
+typedef struct{
+
+	const uint8_t *pre;
+	const uint8_t *suf;
+	uint32_t split;
+
+} cascade_view_t;
+
+
+static int cmpneighbor(const void *a, const void *b){
+
+	const sparsehash_neighbor_t *na = (const sparsehash_neighbor_t*)a, *nb = (const sparsehash_neighbor_t*)b;
+
+	if (na->dist != nb->dist)
+		return (na->dist > nb->dist) - (na->dist < nb->dist);
+	return (na->index > nb->index) - (na->index < nb->index);
+
+}
+
+
+static uint32_t cascade_prefix_bytes(uint32_t m, uint32_t prefix_bits){
+
+	uint32_t bytes;
+
+
+	if (prefix_bits == 0){
+		prefix_bits = m/CASCADE_PREFIX_DIV;
+		if (prefix_bits < CASCADE_MIN_PREFIX)
+			prefix_bits = CASCADE_MIN_PREFIX;
+	}
+
+	// Prefixes are whole bytes, the partial last byte is only compared with the whole sketch
+	bytes = (prefix_bits+7)/8;
+	if (bytes > m/8)
+		bytes = m/8;
+	if (bytes == 0)
+		bytes = 1;
+
+	return bytes;
+
+}
+
+
+void sparsehash_prefix_order(const char *sketch, uint32_t m, char *out){
+
+	uint32_t bits, i, pos, mask;
+	uint64_t r;
+
+
+	for (bits=0; ((uint64_t)1 << bits) < m; ++bits);
+
+	memset(out, 0, (m+7)/8);
+
+	// i is the bit-reversal of r on bits bits, incremented from the top bit down
+	i = 0;
+	pos = 0;
+	for (r=0; r < ((uint64_t)1 << bits); ++r){
+
+		if (i < m){
+			if (sketch[i/8] & (0x80 >> (i%8)))
+				out[pos/8] |= (0x80 >> (pos%8));
+			pos++;
+		}
+
+		if (bits > 0){
+			mask = 1u << (bits-1);
+			while (mask && (i & mask)){
+				i ^= mask;
+				mask >>= 1;
+			}
+			i |= mask;
+		}
+
+	}
+
+}
+
+
+// Add the ones of a, b and a|b in bytes begin to end-1
+static void cascade_counts(const cascade_view_t *a, const cascade_view_t *b, uint32_t begin, uint32_t end, uint64_t *ones){
+
+	uint32_t mid;
+	uint64_t counts[3];
+
+
+	mid = (end < a->split) ? end : a->split;
+	if (begin < mid){
+		simd_popcount_or(a->pre+begin, b->pre+begin, mid-begin, counts);
+		ones[0] += counts[0];
+		ones[1] += counts[1];
+		ones[2] += counts[2];
+	}
+
+	if (begin < a->split)
+		begin = a->split;
+	if (begin < end){
+		simd_popcount_or(a->suf+(begin-a->split), b->suf+(begin-a->split), end-begin, counts);
+		ones[0] += counts[0];
+		ones[1] += counts[1];
+		ones[2] += counts[2];
+	}
+
+}
+
+
+// Estimate of sparsehash_sim_J from the zeros of a, b and a|b over bits bits, in *sim, and its upper confidence bound.
+// With z the fractions of zeros and u = -log(z12), J = (log(z1)+log(z2))/log(z12) - 1; its variance comes from the
+// delta method over the multinomial of the bit pairs. Infinite if the estimate is undefined
+static double cascade_upper(uint32_t nz_1, uint32_t nz_2, uint32_t nzz, uint32_t bits, double confidence, double *sim){
+
+	double z1, z2, z12, a, b, u, g1, g2, g12, var;
+
+
+	z1 = (double)nz_1/bits;
+	z2 = (double)nz_2/bits;
+	z12 = (double)nzz/bits;
+	if (!(z12 > 0 && z12 < 1)){
+		*sim = NAN;
+		return INFINITY;
+	}
+
+	a = -log(z1);
+	b = -log(z2);
+	u = -log(z12);
+	*sim = (a+b)/u - 1;
+
+	g1 = -1/(z1*u);
+	g2 = -1/(z2*u);
+	g12 = (a+b)/(u*u*z12);
+	var = ( g1*g1*z1*(1-z1) + g2*g2*z2*(1-z2) + g12*g12*z12*(1-z12)
+			+ 2*g1*g2*(z12-z1*z2) + 2*g1*g12*z12*(1-z1) + 2*g2*g12*z12*(1-z2) )/bits;
+
+	return *sim + confidence*sqrt((var > 0) ? var : 0);
+
+}
+
+
+// Compare growing prefixes of a and b, as sparsehash_sim_J_cascade. dist is the Hamming distance if not rejected
+static int cascade_compare(const cascade_view_t *a, const cascade_view_t *b, uint32_t m, uint32_t prefix_bytes, double threshold, double confidence, double *sim, uint32_t *dist){
+
+	uint32_t full, done, end, nz_1, nz_2, nzz, extra_bits;
+	uint64_t ones[3] = {0, 0, 0};
+	uint8_t byte_1, byte_2, not_temp_1, not_temp_2;
+
+
+	// The estimate can be slightly negative for unrelated sets, so no threshold at or below 0 rejects on a prefix
+	full = m/8;
+	done = 0;
+	end = (threshold > 0) ? prefix_bytes : full;
+
+	for (;;){
+
+		if (end > full)
+			end = full;
+		cascade_counts(a, b, done, end, ones);
+		done = end;
+		if (end == full)
+			break;
+
+		// Most pairs are far below threshold and stop here, after reading prefix_bytes
+		if (cascade_upper(8*end-ones[0], 8*end-ones[1], 8*end-ones[2], 8*end, confidence, sim) < threshold)
+			return 0;
+		end *= CASCADE_GROWTH;
+
+	}
+
+	nz_1 = 8*full - ones[0];
+	nz_2 = 8*full - ones[1];
+	nzz = 8*full - ones[2];
+
+	extra_bits = m%8;
+	if (extra_bits != 0){
+		byte_1 = (full < a->split) ? a->pre[full] : a->suf[full-a->split];
+		byte_2 = (full < b->split) ? b->pre[full] : b->suf[full-b->split];
+		not_temp_1 = ~( byte_1 | (0xFF >> extra_bits) );
+		not_temp_2 = ~( byte_2 | (0xFF >> extra_bits) );
+		nzz += __builtin_popcount( not_temp_1 & not_temp_2 );
+		nz_1 += __builtin_popcount(not_temp_1);
+		nz_2 += __builtin_popcount(not_temp_2);
+	}
+
+	// Same expression as sparsehash_sim_J, the ones of a^b are 2|a|b| - |a| - |b|
+	*sim = log( ((double)(nz_1)*nz_2)/((double)(nzz)*m) ) / log( (double)(nzz)/m );
+	*dist = nz_1 + nz_2 - 2*nzz;
+
+	return 1;
+
+}
+
+
+int sparsehash_sim_J_cascade(const char *sketch_1, const char *sketch_2, uint32_t bit_len, uint32_t prefix_bits, double threshold, double confidence, double *sim){
+
+	cascade_view_t a, b;
+	uint32_t dist;
+
+
+	a.split = b.split = cascade_prefix_bytes(bit_len, prefix_bits);
+	a.pre = a.suf = (const uint8_t*)sketch_1;
+	b.pre = b.suf = (const uint8_t*)sketch_2;
+	a.suf += a.split;
+	b.suf += b.split;
+
+	return cascade_compare(&a, &b, bit_len, a.split, threshold, confidence, sim, &dist);
+
+}
+
+
+sparsehash_cascade_t* sparsehash_cascade_create(const char *sketches, uint32_t num_sketches, uint32_t m, uint32_t prefix_bits){
+
+	sparsehash_cascade_t *cascade;
+	uint32_t s, rest;
+	int failed = 0;
+
+
+	cascade = (sparsehash_cascade_t*) calloc(1, sizeof(sparsehash_cascade_t));
+	if (cascade == NULL)
+		return NULL;
+
+	cascade->m = m;
+	cascade->mbytes = (m+7)/8;
+	cascade->prefix_bytes = cascade_prefix_bytes(m, prefix_bits);
+	cascade->num_sketches = num_sketches;
+	rest = cascade->mbytes - cascade->prefix_bytes;
+
+	cascade->prefix = (char*) malloc((size_t)cascade->prefix_bytes*num_sketches + 1);
+	cascade->suffix = (char*) malloc((size_t)rest*num_sketches + 1);
+	if (cascade->prefix == NULL || cascade->suffix == NULL){
+		sparsehash_cascade_destroy(cascade);
+		return NULL;
+	}
+
+	#pragma omp parallel
+	{
+
+		char *ordered = (char*) malloc(cascade->mbytes);
+
+		if (ordered == NULL){
+			#pragma omp atomic write
+			failed = 1;
+		}
+		else{
+			#pragma omp for
+			for (s=0; s<num_sketches; ++s){
+				sparsehash_prefix_order(sketches + (size_t)s*cascade->mbytes, m, ordered);
+				memcpy(cascade->prefix + (size_t)s*cascade->prefix_bytes, ordered, cascade->prefix_bytes);
+				memcpy(cascade->suffix + (size_t)s*rest, ordered + cascade->prefix_bytes, rest);
+			}
+		}
+
+		free(ordered);
+
+	}
+
+	if (failed){
+		sparsehash_cascade_destroy(cascade);
+		return NULL;
+	}
+
+	return cascade;
+
+}
+
+
+void sparsehash_cascade_destroy(sparsehash_cascade_t *cascade){
+
+	if (cascade == NULL)
+		return;
+
+	free(cascade->prefix);
+	free(cascade->suffix);
+	free(cascade);
+
+}
+
+
+int64_t sparsehash_cascade_query(const sparsehash_cascade_t *cascade, const char *sketch, double threshold, double confidence, sparsehash_neighbor_t **out){
+
+	cascade_view_t q, v;
+	sparsehash_neighbor_t *neighbors, *grown;
+	uint32_t s, rest, dist, num_out = 0, size = 64;
+	char *ordered;
+	double sim;
+
+
+	ordered = (char*) malloc(cascade->mbytes);
+	neighbors = (sparsehash_neighbor_t*) malloc(sizeof(sparsehash_neighbor_t)*size);
+	if (ordered == NULL || neighbors == NULL){
+		free(ordered);
+		free(neighbors);
+		return -1;
+	}
+
+	sparsehash_prefix_order(sketch, cascade->m, ordered);
+	q.pre = (const uint8_t*)ordered;
+	q.suf = q.pre + cascade->prefix_bytes;
+	q.split = v.split = cascade->prefix_bytes;
+	rest = cascade->mbytes - cascade->prefix_bytes;
+
+	for (s=0; s<cascade->num_sketches; ++s){
+
+		v.pre = (const uint8_t*)cascade->prefix + (size_t)s*cascade->prefix_bytes;
+		v.suf = (const uint8_t*)cascade->suffix + (size_t)s*rest;
+		if (!cascade_compare(&q, &v, cascade->m, cascade->prefix_bytes, threshold, confidence, &sim, &dist) || (threshold > 0 && !(sim >= threshold)))
+			continue;
+
+		if (num_out == size){
+			grown = (sparsehash_neighbor_t*) realloc(neighbors, sizeof(sparsehash_neighbor_t)*2*size);
+			if (grown == NULL){
+				free(ordered);
+				free(neighbors);
+				return -1;
+			}
+			neighbors = grown;
+			size *= 2;
+		}
+		neighbors[num_out].index = s;
+		neighbors[num_out].dist = dist;
+		neighbors[num_out].sim = sim;
+		num_out++;
+
+	}
+
+	free(ordered);
+
+	qsort(neighbors, num_out, sizeof(sparsehash_neighbor_t), cmpneighbor);
+	*out = neighbors;
+
+	return num_out;
+
+}
@@ -0,0 +1,1035 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include "sparsehash.h"
+#include "MurmurHash3.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+// Sets of CHECK_CLUSTERS clusters of CHECK_CLUSTER_SIZE near-duplicates of CHECK_SET_SIZE elements
+#define CHECK_CLUSTERS 200
+#define CHECK_CLUSTER_SIZE 5
+#define CHECK_SET_SIZE 1000
+
+// Elements of a near-duplicate replaced, out of CHECK_SET_SIZE
+#define CHECK_CHANGED 50
+
+// Bits of the sketches of the index checks
+#define CHECK_M 2048
+
+// Fewest of the pairs above the LSH threshold that the index must return
+#define CHECK_LSH_RECALL 0.9
+
+// Threads of the multithreaded checks
+#define CHECK_THREADS 4
+
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do{ \
+		if (!(cond)){ \
+			fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__); \
+			fprintf(stderr, "\n"); \
+			failures++; \
+		} \
+	} while (0)
+
+
+static uint64_t state = 47;
+
+static uint32_t next_rand(void){
+
+	state = state*6364136223846793005ull + 1442695040888963407ull;
+	return (uint32_t)(state >> 33);
+
+}
+
+
+static int cmpneighbor(const void *a, const void *b){
+
+	const sparsehash_neighbor_t *na = (const sparsehash_neighbor_t*)a, *nb = (const sparsehash_neighbor_t*)b;
+
+	if (na->dist != nb->dist)
+		return (na->dist > nb->dist) - (na->dist < nb->dist);
+	return (na->index > nb->index) - (na->index < nb->index);
+
+}
+
+
+// Sketches with a fast plan of m bits of the clustered sets, num_sets = CHECK_CLUSTERS*CHECK_CLUSTER_SIZE
+static char* clustered_sketches(uint32_t m, uint32_t *num_sets){
+
+	sparsehash_plan_t *plan;
+	uint32_t base[CHECK_SET_SIZE], set[CHECK_SET_SIZE], c, d, i;
+	char *sketches;
+
+
+	*num_sets = CHECK_CLUSTERS*CHECK_CLUSTER_SIZE;
+	plan = sparsehash_plan_create(7, get_gamma(CHECK_SET_SIZE), m, SPARSEHASH_FAST);
+	sketches = (char*) malloc((size_t)plan->mbytes*(*num_sets));
+
+	for (c=0; c<CHECK_CLUSTERS; ++c){
+		for (i=0; i<CHECK_SET_SIZE; ++i)
+			base[i] = next_rand();
+		for (d=0; d<CHECK_CLUSTER_SIZE; ++d){
+			memcpy(set, base, sizeof(set));
+			for (i=0; i<CHECK_CHANGED; ++i)
+				set[next_rand() % CHECK_SET_SIZE] = next_rand();
+			sparsehash_sketch_with_plan(plan, set, CHECK_SET_SIZE, 4, NULL, sketches + (size_t)(c*CHECK_CLUSTER_SIZE+d)*plan->mbytes);
+		}
+	}
+
+	sparsehash_plan_destroy(plan);
+
+	return sketches;
+
+}
+
+
+// Set the OpenMP threads of the next parallel regions, the previous number is returned
+static int set_threads(int threads){
+
+#ifdef _OPENMP
+	int previous = omp_get_max_threads();
+	omp_set_num_threads(threads);
+	return previous;
+#else
+	(void)threads;
+	return 1;
+#endif
+
+}
+
+
+// Random integers of element_size bytes, or strings of 1 to 16 bytes for element_size 1 with lengths in str_len
+static void* random_elements(uint32_t n, uint16_t element_size, uint16_t **str_len){
+
+	char **strings, *chars;
+	uint8_t *ints;
+	size_t i;
+
+
+	if (element_size != 1){
+		ints = (uint8_t*) malloc((size_t)element_size*n + 1);
+		for (i=0; i<(size_t)element_size*n; ++i)
+			ints[i] = (uint8_t)next_rand();
+		*str_len = NULL;
+		return ints;
+	}
+
+	strings = (char**) malloc(sizeof(char*)*n + sizeof(char*));
+	chars = (char*) malloc((size_t)16*n + 1);
+	*str_len = (uint16_t*) malloc(sizeof(uint16_t)*n + 1);
+	for (i=0; i<n; ++i){
+		strings[i] = chars + 16*i;
+		(*str_len)[i] = 1 + next_rand()%16;
+		for (size_t j=0; j<16; ++j)
+			strings[i][j] = (char)next_rand();
+	}
+	strings[n] = chars;
+
+	return strings;
+
+}
+
+
+static void free_elements(void *data, uint16_t element_size, uint32_t n, uint16_t *str_len){
+
+	if (element_size == 1)
+		free(((char**)data)[n]);
+	free(data);
+	free(str_len);
+
+}
+
+
+// Ones in the m bits of sketch
+static uint32_t ones(const char *sketch, uint32_t m){
+
+	uint32_t i, count = 0;
+
+
+	for (i=0; i<m; ++i)
+		count += (sketch[i/8] >> (7-i%8)) & 1;
+
+	return count;
+
+}
+
+
+// Flip the lowest bit of the byte at offset of the file at path. 0 if successful
+static int flip_byte(const char *path, long offset){
+
+	FILE *fp;
+	int c, err;
+
+
+	fp = fopen(path, "r+b");
+	if (fp == NULL)
+		return -1;
+	err = fseek(fp, offset, SEEK_SET) != 0 || (c = fgetc(fp)) == EOF || fseek(fp, offset, SEEK_SET) != 0 || fputc(c ^ 1, fp) == EOF;
+	if (fclose(fp) != 0)
+		err = 1;
+
+	return err ? -1 : 0;
+
+}
+
+
+// 1 if the plan file at path is rejected
+static int plan_rejected(const char *path){
+
+	sparsehash_plan_t *plan = sparsehash_plan_map(path);
+
+
+	sparsehash_plan_destroy(plan);
+
+	return plan == NULL;
+
+}
+
+
+// The 8-lane and fixed-width hashes against MurmurHash3_x64_128 and the byte-wise versions, lengths 0 to 100 for the
+// lanes so that every tail and several body blocks are covered, and every fixed width
+static void check_hashes(void){
+
+	static const int widths[] = {1, 2, 4, 8};
+	uint8_t key[100];
+	uint32_t seeds[MURMUR_LANES], r, l, w;
+	uint64_t lanes[MURMUR_LANES], full[2], value;
+	int len;
+
+
+	for (r=0; r<20; ++r){
+
+		for (len=0; len<(int)sizeof(key); ++len)
+			key[len] = (uint8_t)next_rand();
+		for (l=0; l<MURMUR_LANES; ++l)
+			seeds[l] = next_rand();
+
+		for (len=0; len<=(int)sizeof(key); ++len){
+			MurmurHash3_x64_64_lanes(key, len, seeds, lanes);
+			for (l=0; l<MURMUR_LANES; ++l){
+				MurmurHash3_x64_128(key, len, seeds[l], full);
+				CHECK(lanes[l] == full[0], "lane %u of a %d-byte key", l, len);
+				CHECK(hashfn_murmur3_bytes(key, len, seeds[l]) == full[0], "murmur3 bytes of a %d-byte key", len);
+			}
+		}
+
+		// Keys by value are the little-endian bytes
+		for (w=0; w<sizeof(widths)/sizeof(widths[0]); ++w){
+			value = 0;
+			for (len=widths[w]-1; len>=0; --len)
+				value = (value << 8) | key[len];
+			CHECK(hashfn_murmur3_fixed(value, widths[w], seeds[0]) == hashfn_murmur3_bytes(key, widths[w], seeds[0]), "murmur3 fixed width %d", widths[w]);
+			CHECK(hashfn_wyhash_fixed(value, widths[w], seeds[0]) == hashfn_wyhash_bytes(key, widths[w], seeds[0]), "wyhash fixed width %d", widths[w]);
+		}
+
+	}
+
+}
+
+
+// Chunked sparsehash_update against one-shot sketches, every variant, hash and element size
+static void check_update(void){
+
+	static const uint16_t sizes[] = {1, 2, 4, 8};
+	const uint32_t n = 600, m = 500;
+	sparsehash_plan_t *plan;
+	char *chars, **strings, *one, *chunked;
+	uint16_t str_len[600];
+	uint8_t *ints;
+	uint32_t v, h, s, i, done, chunk;
+	uint16_t size;
+	void *data;
+
+
+	ints = (uint8_t*) malloc(8*n);
+	chars = (char*) malloc(16*n);
+	strings = (char**) malloc(sizeof(char*)*n);
+	for (i=0; i<8*n; ++i)
+		ints[i] = (uint8_t)next_rand();
+	for (i=0; i<n; ++i){
+		strings[i] = chars + 16*i;
+		str_len[i] = 1 + next_rand()%16;
+		for (s=0; s<16; ++s)
+			strings[i][s] = (char)next_rand();
+	}
+
+	for (v=SPARSEHASH_EXACT; v<=SPARSEHASH_FAST; ++v){
+		for (h=SPARSEHASH_HASH_MURMUR3; h<=SPARSEHASH_HASH_WYHASH; ++h){
+
+			plan = sparsehash_plan_create(3, 0.01, m, (sparsehash_variant_t)v);
+			CHECK(plan != NULL && sparsehash_plan_set_hash(plan, (sparsehash_hash_t)h) == 0, "plan of variant %u hash %u", v, h);
+			if (plan == NULL)
+				continue;
+			one = (char*) malloc(plan->mbytes);
+			chunked = (char*) malloc(plan->mbytes);
+
+			for (s=0; s<sizeof(sizes)/sizeof(sizes[0]); ++s){
+				size = sizes[s];
+				data = (size == 1) ? (void*)strings : (void*)ints;
+				sparsehash_sketch_with_plan(plan, data, n, size, (size == 1) ? str_len : NULL, one);
+
+				memset(chunked, 0, plan->mbytes);
+				for (done=0; done<n; done+=chunk){
+					chunk = 1 + next_rand()%100;
+					if (chunk > n-done)
+						chunk = n-done;
+					if (size == 1)
+						sparsehash_update(plan, chunked, strings+done, chunk, 1, str_len+done);
+					else
+						sparsehash_update(plan, chunked, ints+(size_t)size*done, chunk, size, NULL);
+				}
+				CHECK(memcmp(one, chunked, plan->mbytes) == 0, "update of variant %u hash %u element size %u", v, h, size);
+			}
+
+			free(one);
+			free(chunked);
+			sparsehash_plan_destroy(plan);
+
+		}
+	}
+
+	free(ints);
+	free(chars);
+	free(strings);
+
+}
+
+
+// sparsehash_sketch_batch against sparsehash_sketch_with_plan on each set, with sets split across threads and sets of one chunk
+static void check_batch(void){
+
+	static const uint32_t sizes[] = {0, 1, 65536, 65537, 200000, 3, 0, 1000, 70000, 17};
+	static const uint16_t element_sizes[] = {4, 1};
+	const uint32_t num_sets = sizeof(sizes)/sizeof(sizes[0]), m = 500;
+	uint64_t offsets[sizeof(sizes)/sizeof(sizes[0]) + 1];
+	sparsehash_plan_t *plan;
+	char *batch, *one;
+	uint16_t *str_len, element_size;
+	uint32_t v, e, t, s, total;
+	int threads, saved = set_threads(1);
+	void *data;
+
+
+	offsets[0] = 0;
+	for (s=0; s<num_sets; ++s)
+		offsets[s+1] = offsets[s] + sizes[s];
+	total = (uint32_t)offsets[num_sets];
+
+	for (e=0; e<sizeof(element_sizes)/sizeof(element_sizes[0]); ++e){
+
+		element_size = element_sizes[e];
+		data = random_elements(total, element_size, &str_len);
+
+		for (v=SPARSEHASH_EXACT; v<=SPARSEHASH_FAST; ++v){
+
+			plan = sparsehash_plan_create(11, get_gamma(1000), m, (sparsehash_variant_t)v);
+			batch = (char*) malloc((size_t)plan->mbytes*num_sets);
+			one = (char*) malloc(plan->mbytes);
+
+			for (t=0; t<2; ++t){
+				threads = (t == 0) ? 1 : CHECK_THREADS;
+				set_threads(threads);
+				CHECK(sparsehash_sketch_batch(plan, data, offsets, num_sets, element_size, str_len, batch) == 0, "batch of variant %u", v);
+				for (s=0; s<num_sets; ++s){
+					if (element_size == 1)
+						sparsehash_sketch_with_plan(plan, (char**)data + offsets[s], sizes[s], 1, str_len + offsets[s], one);
+					else
+						sparsehash_sketch_with_plan(plan, (uint8_t*)data + (size_t)element_size*offsets[s], sizes[s], element_size, NULL, one);
+					CHECK(memcmp(batch + (size_t)s*plan->mbytes, one, plan->mbytes) == 0, "batch set %u of %u elements, variant %u, element size %u, %d threads",
+						  s, sizes[s], v, element_size, threads);
+				}
+			}
+
+			free(batch);
+			free(one);
+			sparsehash_plan_destroy(plan);
+
+		}
+
+		free_elements(data, element_size, total, str_len);
+
+	}
+
+	set_threads(saved);
+
+}
+
+
+// Sketch of n packed keys of key_size bytes with the intervals of plan by brute force: bit i is set if some hash is
+// in [bot[i], top[i]). Intervals are sorted by bottom, so only those starting less than the widest width below a hash are scanned
+static void brute_force_sketch(const sparsehash_plan_t *plan, const uint8_t *keys, uint32_t n, int key_size, char *out){
+
+	uint64_t width = 0, hash, low;
+	uint32_t i, j, lo, hi, mid;
+
+
+	memset(out, 0, plan->mbytes);
+	for (i=0; i<plan->m; ++i)
+		if (plan->top[i] - plan->bot[i] > width)
+			width = plan->top[i] - plan->bot[i];
+
+	for (j=0; j<n; ++j){
+		hash = (plan->hash == SPARSEHASH_HASH_MURMUR3) ? hashfn_murmur3_bytes(keys + (size_t)j*key_size, key_size, plan->hash_seed)
+													  : hashfn_wyhash_bytes(keys + (size_t)j*key_size, key_size, plan->hash_seed);
+		low = (hash >= width) ? hash-width : 0;
+		// First bottom above hash
+		lo = 0;
+		hi = plan->m;
+		while (lo < hi){
+			mid = lo + (hi-lo)/2;
+			if (plan->bot[mid] <= hash)
+				lo = mid+1;
+			else
+				hi = mid;
+		}
+		for (i=lo; i>0 && plan->bot[i-1] >= low; --i)
+			if (hash < plan->top[i-1])
+				out[(i-1)/8] |= 0x80 >> ((i-1)%8);
+	}
+
+}
+
+
+// Every lookup of the fast version, with several bucket widths, and the medium version against brute force,
+// on one thread and on enough threads for the multithreaded fast lookup
+static void check_lookup(void){
+
+	static const uint32_t ms[] = {1, 7, 8, 9, 63, 64, 65, 1000, 4099, 100000};
+	static const uint32_t ns[] = {1, 100, 5000, 70000};
+	static const sparsehash_lookup_t lookups[] = {SPARSEHASH_LOOKUP_TREE, SPARSEHASH_LOOKUP_BINARY, SPARSEHASH_LOOKUP_EYTZINGER,
+												  SPARSEHASH_LOOKUP_BUCKET, SPARSEHASH_LOOKUP_SWEEP};
+	static const uint32_t bucket_bits[] = {1, 4, 16};
+	const uint32_t max_n = 70000;
+	sparsehash_plan_t *plan, *medium;
+	char *expected, *got;
+	uint16_t *str_len;
+	uint32_t im, in, l, b, t, key_size;
+	int threads, saved = set_threads(1);
+	void *data;
+
+
+	data = random_elements(max_n, 8, &str_len);
+
+	for (im=0; im<sizeof(ms)/sizeof(ms[0]); ++im){
+		for (in=0; in<sizeof(ns)/sizeof(ns[0]); ++in){
+
+			key_size = (in % 2 == 0) ? 4 : 8;
+			plan = sparsehash_plan_create(17 + im, get_gamma(ns[in]), ms[im], SPARSEHASH_FAST);
+			CHECK(plan != NULL && sparsehash_plan_set_hash(plan, (in < 2) ? SPARSEHASH_HASH_MURMUR3 : SPARSEHASH_HASH_WYHASH) == 0, "plan of %u bits", ms[im]);
+			if (plan == NULL)
+				continue;
+			expected = (char*) malloc(plan->mbytes);
+			got = (char*) malloc(plan->mbytes);
+			brute_force_sketch(plan, (const uint8_t*)data, ns[in], key_size, expected);
+
+			for (t=0; t<2; ++t){
+				threads = (t == 0) ? 1 : CHECK_THREADS;
+				set_threads(threads);
+
+				for (l=0; l<sizeof(lookups)/sizeof(lookups[0]); ++l){
+					for (b=0; b<((lookups[l] == SPARSEHASH_LOOKUP_BUCKET) ? sizeof(bucket_bits)/sizeof(bucket_bits[0]) + 1 : 1); ++b){
+						if (b == 0)
+							CHECK(sparsehash_plan_set_lookup(plan, lookups[l]) == 0, "lookup %u of %u bits", l, ms[im]);
+						else
+							CHECK(sparsehash_plan_set_bucket_bits(plan, bucket_bits[b-1]) == 0, "%u bucket bits", bucket_bits[b-1]);
+						sparsehash_sketch_with_plan(plan, data, ns[in], key_size, NULL, got);
+						CHECK(memcmp(expected, got, plan->mbytes) == 0, "fast lookup %u (%u bucket bits) of %u bits, %u elements of %u bytes, %d threads",
+							  l, plan->bucket_bits, ms[im], ns[in], key_size, threads);
+					}
+				}
+
+				// The medium version scans every interval, so only the smaller sketches
+				if ((uint64_t)ms[im]*ns[in] <= 100000000){
+					medium = sparsehash_plan_create(17 + im, get_gamma(ns[in]), ms[im], SPARSEHASH_MEDIUM);
+					sparsehash_plan_set_hash(medium, plan->hash);
+					sparsehash_sketch_with_plan(medium, data, ns[in], key_size, NULL, got);
+					CHECK(memcmp(expected, got, plan->mbytes) == 0, "medium version of %u bits, %u elements, %d threads", ms[im], ns[in], threads);
+					sparsehash_plan_destroy(medium);
+				}
+			}
+
+			free(expected);
+			free(got);
+			sparsehash_plan_destroy(plan);
+
+		}
+	}
+
+	free_elements(data, 8, max_n, str_len);
+	set_threads(saved);
+
+}
+
+
+// Sketches of a saved and mapped plan against the plan in memory, every variant and lookup, and corrupt files are rejected
+static void check_planfile(void){
+
+	static const sparsehash_lookup_t lookups[] = {SPARSEHASH_LOOKUP_TREE, SPARSEHASH_LOOKUP_BINARY, SPARSEHASH_LOOKUP_EYTZINGER,
+												  SPARSEHASH_LOOKUP_BUCKET, SPARSEHASH_LOOKUP_SWEEP};
+	const uint32_t n = 3000, m = 1001;
+	sparsehash_plan_t *plan, *mapped;
+	char path[] = "/tmp/sparsehash_check_XXXXXX", *one, *two;
+	uint16_t *str_len;
+	uint32_t v, e, l, saved_eytz;
+	uint64_t idx_offset;
+	void *data;
+	FILE *fp;
+	int fd;
+
+
+	fd = mkstemp(path);
+	CHECK(fd >= 0, "temporary file");
+	if (fd < 0)
+		return;
+	close(fd);
+	data = random_elements(n, 8, &str_len);
+
+	for (v=SPARSEHASH_EXACT; v<=SPARSEHASH_FAST; ++v){
+		for (saved_eytz=0; saved_eytz<=(v == SPARSEHASH_FAST); ++saved_eytz){
+
+			plan = sparsehash_plan_create(13, get_gamma(n), m, (sparsehash_variant_t)v);
+			CHECK(sparsehash_plan_set_hash(plan, SPARSEHASH_HASH_WYHASH) == 0, "hash of variant %u", v);
+			if (saved_eytz)
+				sparsehash_plan_set_lookup(plan, SPARSEHASH_LOOKUP_EYTZINGER);
+			CHECK(sparsehash_plan_save(plan, path) == 0, "saving plan of variant %u", v);
+			mapped = sparsehash_plan_map(path);
+			CHECK(mapped != NULL, "mapping plan of variant %u", v);
+			if (mapped == NULL){
+				sparsehash_plan_destroy(plan);
+				continue;
+			}
+			CHECK(mapped->variant == plan->variant && mapped->seed == plan->seed && mapped->gamma == plan->gamma && mapped->m == plan->m
+				  && mapped->tau == plan->tau && mapped->hash == plan->hash && mapped->hash_seed == plan->hash_seed, "parameters of mapped plan of variant %u", v);
+			CHECK(v != SPARSEHASH_FAST || mapped->lookup == (saved_eytz ? SPARSEHASH_LOOKUP_EYTZINGER : SPARSEHASH_LOOKUP_BINARY), "lookup of mapped plan");
+
+			one = (char*) malloc(plan->mbytes);
+			two = (char*) malloc(plan->mbytes);
+			for (e=0; e<2; ++e){
+				for (l=0; l<((v == SPARSEHASH_FAST) ? sizeof(lookups)/sizeof(lookups[0]) : 1); ++l){
+					if (v == SPARSEHASH_FAST){
+						sparsehash_plan_set_lookup(plan, lookups[l]);
+						sparsehash_plan_set_lookup(mapped, lookups[l]);
+					}
+					sparsehash_sketch_with_plan(plan, data, n, (e == 0) ? 4 : 8, NULL, one);
+					sparsehash_sketch_with_plan(mapped, data, n, (e == 0) ? 4 : 8, NULL, two);
+					CHECK(memcmp(one, two, plan->mbytes) == 0, "mapped plan of variant %u, lookup %u, element size %u", v, l, (e == 0) ? 4 : 8);
+				}
+			}
+			free(one);
+			free(two);
+			sparsehash_plan_destroy(mapped);
+			sparsehash_plan_destroy(plan);
+
+		}
+	}
+
+	// Last file, a fast plan with the Eytzinger tables: the version is byte 8 of the header and the offset of the Eytzinger
+	// positions byte 88. A wrong version, then a position past m, are rejected
+	CHECK(flip_byte(path, 8) == 0 && plan_rejected(path) && flip_byte(path, 8) == 0 && !plan_rejected(path), "plan of another version accepted");
+	fp = fopen(path, "rb");
+	CHECK(fp != NULL && fseek(fp, 88, SEEK_SET) == 0 && fread(&idx_offset, sizeof(uint64_t), 1, fp) == 1, "reading the Eytzinger offset");
+	if (fp != NULL)
+		fclose(fp);
+	CHECK(flip_byte(path, idx_offset + 4*10 + 3) == 0 && plan_rejected(path), "plan with a corrupt Eytzinger table accepted");
+
+	unlink(path);
+	free_elements(data, 8, n, str_len);
+
+}
+
+
+// The CLI on a small u16 file against sparsehash_sketch_with_plan with the same parameters, needs ./main
+static void check_cli(void){
+
+	static const char *variants[] = {"exact", "medium", "fast"}, *hashes[] = {"murmur3", "wyhash"};
+	const uint32_t n = 4700, m = 1001, seed = 47;
+	sparsehash_plan_t *plan;
+	char in_path[] = "/tmp/sparsehash_check_XXXXXX", out_path[] = "/tmp/sparsehash_check_XXXXXX", cmd[256], *one, *two;
+	uint16_t values[4700];
+	uint32_t v, h, i;
+	FILE *fp;
+	int in_fd, out_fd;
+
+
+	in_fd = mkstemp(in_path);
+	out_fd = mkstemp(out_path);
+	CHECK(in_fd >= 0 && out_fd >= 0, "temporary files");
+	if (in_fd < 0 || out_fd < 0)
+		return;
+	close(out_fd);
+	for (i=0; i<n; ++i)
+		values[i] = (uint16_t)next_rand();
+	CHECK(write(in_fd, values, sizeof(values)) == (ssize_t)sizeof(values), "writing the u16 input");
+	close(in_fd);
+
+	for (v=SPARSEHASH_EXACT; v<=SPARSEHASH_FAST; ++v){
+		for (h=SPARSEHASH_HASH_MURMUR3; h<=SPARSEHASH_HASH_WYHASH; ++h){
+
+			plan = sparsehash_plan_create(seed, get_gamma(n), m, (sparsehash_variant_t)v);
+			sparsehash_plan_set_hash(plan, (sparsehash_hash_t)h);
+			one = (char*) malloc(plan->mbytes);
+			two = (char*) calloc(1, plan->mbytes);
+			sparsehash_sketch_with_plan(plan, values, n, 2, NULL, one);
+
+			snprintf(cmd, sizeof(cmd), "./main -f u16 -v %s -H %s -m %u -s %u -S %u -o %s %s", variants[v], hashes[h], m, n, seed, out_path, in_path);
+			CHECK(system(cmd) == 0, "running %s", cmd);
+			fp = fopen(out_path, "rb");
+			CHECK(fp != NULL && fread(two, 1, plan->mbytes, fp) == plan->mbytes && fgetc(fp) == EOF, "reading the output of %s", cmd);
+			if (fp != NULL)
+				fclose(fp);
+			CHECK(memcmp(one, two, plan->mbytes) == 0, "sketch of %s", cmd);
+
+			free(one);
+			free(two);
+			sparsehash_plan_destroy(plan);
+
+		}
+	}
+
+	unlink(in_path);
+	unlink(out_path);
+
+}
+
+
+// sparsehash_allpairs, _write and _threshold against sparsehash_sim_J and sparsehash_dist_H on every pair
+static void check_allpairs(const char *sketches, uint32_t num_sets, uint32_t m){
+
+	const double thresholds[2] = {0.5, 400};
+	uint32_t mbytes = (m+7)/8, i, j, f;
+	uint64_t entries = (uint64_t)num_sets*(num_sets-1)/2, e, num_pairs;
+	double *matrix, *written, expected;
+	sparsehash_pair_t pair;
+	sparsehash_measure_t measure;
+	int64_t num_threshold;
+	FILE *fp;
+
+
+	matrix = (double*) malloc(sizeof(double)*entries);
+	written = (double*) malloc(sizeof(double)*entries);
+
+	for (f=0; f<2; ++f){
+
+		measure = (f == 0) ? SPARSEHASH_MEASURE_JACCARD : SPARSEHASH_MEASURE_HAMMING;
+		CHECK(sparsehash_allpairs(sketches, num_sets, m, measure, matrix) == 0, "allpairs of measure %u", f);
+
+		// Jaccard entries up to rounding, Hamming entries exactly
+		e = 0;
+		num_pairs = 0;
+		for (i=0; i<num_sets; ++i){
+			for (j=i+1; j<num_sets; ++j, ++e){
+				expected = (f == 0) ? sparsehash_sim_J(sketches + (size_t)i*mbytes, sketches + (size_t)j*mbytes, m)
+									: sparsehash_dist_H(sketches + (size_t)i*mbytes, sketches + (size_t)j*mbytes, m);
+				CHECK((f == 0) ? fabs(matrix[e] - expected) <= 1e-12 : matrix[e] == expected, "allpairs entry %u, %u of measure %u: %.17g, expected %.17g",
+					  i, j, f, matrix[e], expected);
+				num_pairs += (f == 0) ? (matrix[e] >= thresholds[f]) : (matrix[e] <= thresholds[f]);
+			}
+		}
+
+		fp = tmpfile();
+		CHECK(fp != NULL && sparsehash_allpairs_write(sketches, num_sets, m, measure, fp) == 0 && fseek(fp, 0, SEEK_SET) == 0
+			  && fread(written, sizeof(double), entries, fp) == entries && memcmp(written, matrix, sizeof(double)*entries) == 0, "allpairs_write of measure %u", f);
+		if (fp != NULL)
+			fclose(fp);
+
+		// Pairs in row order, the entries of the matrix passing the threshold
+		fp = tmpfile();
+		num_threshold = (fp != NULL) ? sparsehash_allpairs_threshold(sketches, num_sets, m, measure, thresholds[f], fp) : -1;
+		CHECK(num_threshold >= 0 && (uint64_t)num_threshold == num_pairs && num_pairs > 0, "allpairs_threshold of measure %u: %ld pairs, expected %lu",
+			  f, (long)num_threshold, (unsigned long)num_pairs);
+		if (fp != NULL && fseek(fp, 0, SEEK_SET) == 0){
+			e = 0;
+			for (i=0; i<num_sets; ++i){
+				for (j=i+1; j<num_sets; ++j, ++e){
+					if ((f == 0) ? (matrix[e] >= thresholds[f]) : (matrix[e] <= thresholds[f])){
+						CHECK(fread(&pair, sizeof(pair), 1, fp) == 1 && pair.i == i && pair.j == j && pair.value == matrix[e], "allpairs_threshold pair %u, %u", i, j);
+					}
+				}
+			}
+		}
+		if (fp != NULL)
+			fclose(fp);
+
+	}
+
+	free(matrix);
+	free(written);
+
+}
+
+
+// sparsehash_topk against a sort of all the distances
+static void check_topk(const char *sketches, uint32_t num_sets, uint32_t m){
+
+	const uint32_t k = 10, num_queries = 50;
+	sparsehash_neighbor_t *out, *all;
+	uint32_t mbytes = (m+7)/8, q, s, j;
+
+
+	out = (sparsehash_neighbor_t*) malloc(sizeof(sparsehash_neighbor_t)*k*num_queries);
+	all = (sparsehash_neighbor_t*) malloc(sizeof(sparsehash_neighbor_t)*num_sets);
+
+	// Queries are the first sketches, so each finds itself first
+	CHECK(sparsehash_topk(sketches, num_sets, sketches, num_queries, m, k, out) == 0, "topk failed");
+
+	for (q=0; q<num_queries; ++q){
+		for (s=0; s<num_sets; ++s){
+			all[s].index = s;
+			all[s].dist = sparsehash_dist_H(sketches + (size_t)q*mbytes, sketches + (size_t)s*mbytes, m);
+		}
+		qsort(all, num_sets, sizeof(sparsehash_neighbor_t), cmpneighbor);
+		for (j=0; j<k; ++j)
+			CHECK(out[q*k+j].index == all[j].index && out[q*k+j].dist == all[j].dist, "topk query %u rank %u: %u at %u, expected %u at %u",
+				  q, j, out[q*k+j].index, out[q*k+j].dist, all[j].index, all[j].dist);
+	}
+
+	// A collection shorter than k is padded
+	CHECK(sparsehash_topk(sketches, 3, sketches, 1, m, k, out) == 0 && out[2].index != UINT32_MAX && out[3].index == UINT32_MAX, "topk padding");
+
+	free(out);
+	free(all);
+
+}
+
+
+// Results of a query against the pairs found by brute force, in index order with the same distance. Number of misses
+static uint32_t compare_results(const char *name, uint32_t q, sparsehash_neighbor_t *got, int64_t num_got, sparsehash_neighbor_t *expected, uint32_t num_expected){
+
+	uint32_t i, j, misses = 0;
+	int64_t g;
+
+
+	CHECK(num_got >= 0, "%s query %u failed", name, q);
+	for (g=0; g<num_got; ++g){
+		for (j=0; j<num_expected && expected[j].index != got[g].index; ++j);
+		CHECK(j < num_expected && expected[j].dist == got[g].dist && expected[j].sim == got[g].sim, "%s query %u returned %u, not a neighbour", name, q, got[g].index);
+	}
+	for (i=0; i<num_expected; ++i){
+		for (g=0; g<num_got && got[g].index != expected[i].index; ++g);
+		misses += (g == num_got);
+	}
+	for (g=1; g<num_got; ++g)
+		CHECK(got[g-1].dist <= got[g].dist, "%s query %u not sorted", name, q);
+
+	return misses;
+
+}
+
+
+// LSH returns only pairs above threshold with their sparsehash_sim_J, and most of them. MIH returns exactly the pairs within radius
+static void check_index(const char *sketches, uint32_t num_sets, uint32_t m){
+
+	const double threshold = 0.7;
+	const uint32_t radii[] = {0, 60, 150, 400};
+	sparsehash_lsh_t *lsh;
+	sparsehash_mih_t *mih;
+	sparsehash_neighbor_t *expected, *got;
+	uint32_t mbytes = (m+7)/8, bands, rows, q, s, r, num_expected, total = 0, misses = 0;
+	int64_t num_got;
+	double sim;
+
+
+	expected = (sparsehash_neighbor_t*) malloc(sizeof(sparsehash_neighbor_t)*num_sets);
+
+	CHECK(sparsehash_lsh_params(threshold, m, &bands, &rows) == 0, "lsh_params failed");
+	lsh = sparsehash_lsh_create(m, bands, rows);
+	CHECK(lsh != NULL && sparsehash_lsh_insert(lsh, sketches, num_sets) == 0, "lsh build failed");
+
+	for (q=0; lsh != NULL && q<num_sets; ++q){
+		num_expected = 0;
+		for (s=0; s<num_sets; ++s){
+			sim = sparsehash_sim_J(sketches + (size_t)q*mbytes, sketches + (size_t)s*mbytes, m);
+			if (sim >= threshold){
+				expected[num_expected].index = s;
+				expected[num_expected].dist = sparsehash_dist_H(sketches + (size_t)q*mbytes, sketches + (size_t)s*mbytes, m);
+				expected[num_expected++].sim = sim;
+			}
+		}
+		num_got = sparsehash_lsh_query(lsh, sketches + (size_t)q*mbytes, threshold, &got);
+		misses += compare_results("lsh", q, got, num_got, expected, num_expected);
+		total += num_expected;
+		if (num_got >= 0)
+			free(got);
+	}
+	CHECK(total > num_sets && misses <= (1-CHECK_LSH_RECALL)*total, "lsh recall %u of %u", total-misses, total);
+	sparsehash_lsh_destroy(lsh);
+
+	mih = sparsehash_mih_create(m, sparsehash_mih_substrings(m, num_sets));
+	CHECK(mih != NULL && sparsehash_lsh_insert(mih, sketches, num_sets) == 0, "mih build failed");
+
+	for (r=0; mih != NULL && r<sizeof(radii)/sizeof(radii[0]); ++r){
+		for (q=0; q<num_sets; q+=7){
+			num_expected = 0;
+			for (s=0; s<num_sets; ++s){
+				expected[num_expected].index = s;
+				expected[num_expected].dist = sparsehash_dist_H(sketches + (size_t)q*mbytes, sketches + (size_t)s*mbytes, m);
+				expected[num_expected].sim = sparsehash_sim_J(sketches + (size_t)q*mbytes, sketches + (size_t)s*mbytes, m);
+				num_expected += (expected[num_expected].dist <= radii[r]);
+			}
+			num_got = sparsehash_mih_query(mih, sketches + (size_t)q*mbytes, radii[r], &got);
+			CHECK(compare_results("mih", q, got, num_got, expected, num_expected) == 0, "mih query %u radius %u missed neighbours", q, radii[r]);
+			if (num_got >= 0)
+				free(got);
+		}
+	}
+	sparsehash_lsh_destroy(mih);
+
+	free(expected);
+
+}
+
+
+// sparsehash_cascade_query and sparsehash_sim_J_cascade against a scan with sparsehash_sim_J. At threshold 0 or below every
+// sketch is compared in full and returned, also with a negative estimate. Near duplicates are all found, with the exact estimate
+static void check_cascade(const char *sketches, uint32_t num_sets, uint32_t m){
+
+	static const double thresholds[] = {-1, 0, 0.7};
+	static const uint32_t prefixes[] = {0, 64};
+	const double confidence = 3;
+	sparsehash_cascade_t *cascade;
+	sparsehash_neighbor_t *expected, *got;
+	uint32_t mbytes = (m+7)/8, t, p, q, s, num_expected, total = 0, misses = 0;
+	int64_t num_got;
+	double sim, got_sim;
+	int full;
+
+
+	expected = (sparsehash_neighbor_t*) malloc(sizeof(sparsehash_neighbor_t)*num_sets);
+
+	for (p=0; p<sizeof(prefixes)/sizeof(prefixes[0]); ++p){
+
+		cascade = sparsehash_cascade_create(sketches, num_sets, m, prefixes[p]);
+		CHECK(cascade != NULL, "cascade with prefix %u", prefixes[p]);
+		if (cascade == NULL)
+			continue;
+
+		for (t=0; t<sizeof(thresholds)/sizeof(thresholds[0]); ++t){
+			for (q=0; q<num_sets; q+=7){
+				num_expected = 0;
+				for (s=0; s<num_sets; ++s){
+					sim = sparsehash_sim_J(sketches + (size_t)q*mbytes, sketches + (size_t)s*mbytes, m);
+					full = sparsehash_sim_J_cascade(sketches + (size_t)q*mbytes, sketches + (size_t)s*mbytes, m, prefixes[p], thresholds[t], confidence, &got_sim);
+					CHECK(!full || got_sim == sim, "sim_J_cascade of %u, %u with prefix %u: %g, expected %g", q, s, prefixes[p], got_sim, sim);
+					CHECK(full || thresholds[t] > 0, "sim_J_cascade of %u, %u rejected below threshold 0", q, s);
+					if (thresholds[t] <= 0 || sim >= thresholds[t]){
+						expected[num_expected].index = s;
+						expected[num_expected].dist = sparsehash_dist_H(sketches + (size_t)q*mbytes, sketches + (size_t)s*mbytes, m);
+						expected[num_expected++].sim = sim;
+						misses += !full;
+					}
+				}
+				num_got = sparsehash_cascade_query(cascade, sketches + (size_t)q*mbytes, thresholds[t], confidence, &got);
+				misses += compare_results("cascade", q, got, num_got, expected, num_expected);
+				total += 2*num_expected;
+				CHECK(thresholds[t] > 0 || num_got == num_sets, "cascade query %u below threshold 0 returned %lld sketches", q, (long long)num_got);
+				if (num_got >= 0)
+					free(got);
+			}
+		}
+
+		sparsehash_cascade_destroy(cascade);
+
+	}
+
+	CHECK(misses == 0, "cascade missed %u of %u neighbours", misses, total);
+
+	free(expected);
+
+}
+
+
+// Merged sketches of the parts of a set, and the sharded sketch of a key file, against sparsehash_sketch_keys
+static void check_merge(void){
+
+	static const uint32_t key_sizes[] = {3, 8, 16}, workers[] = {1, 3, 8};
+	const uint32_t n = 5000, parts = 4, m = 1000;
+	sparsehash_plan_t *plan;
+	char path[] = "/tmp/sparsehash_check_XXXXXX", *one, *merged, *partial;
+	uint8_t *keys;
+	uint32_t v, k, w, p, i;
+	FILE *fp;
+	int fd;
+
+
+	keys = (uint8_t*) malloc(16*n);
+	for (i=0; i<16*n; ++i)
+		keys[i] = (uint8_t)next_rand();
+
+	for (v=SPARSEHASH_EXACT; v<=SPARSEHASH_FAST; ++v){
+
+		plan = sparsehash_plan_create(5, 0.001, m, (sparsehash_variant_t)v);
+		one = (char*) malloc(plan->mbytes);
+		merged = (char*) malloc(plan->mbytes);
+		partial = (char*) malloc((size_t)parts*plan->mbytes);
+
+		for (k=0; k<sizeof(key_sizes)/sizeof(key_sizes[0]); ++k){
+
+			sparsehash_sketch_keys(plan, keys, n, key_sizes[k], one);
+
+			for (p=0; p<parts; ++p)
+				sparsehash_sketch_keys(plan, keys + (size_t)key_sizes[k]*(n/parts)*p, n/parts, key_sizes[k], partial + (size_t)p*plan->mbytes);
+			sparsehash_merge(merged, partial, parts, m);
+			CHECK(memcmp(one, merged, plan->mbytes) == 0, "merge of variant %u key size %u", v, key_sizes[k]);
+
+			fd = mkstemp(path);
+			fp = (fd >= 0) ? fdopen(fd, "wb") : NULL;
+			CHECK(fp != NULL && fwrite(keys, key_sizes[k], n, fp) == n && fclose(fp) == 0, "writing %s", path);
+			for (w=0; fp != NULL && w<sizeof(workers)/sizeof(workers[0]); ++w){
+				memset(merged, 0xFF, plan->mbytes);
+				CHECK(sparsehash_sketch_file_sharded(plan, path, key_sizes[k], workers[w], merged) == 0 && memcmp(one, merged, plan->mbytes) == 0,
+					  "sharded sketch of variant %u key size %u with %u workers", v, key_sizes[k], workers[w]);
+			}
+			unlink(path);
+			strcpy(path + strlen(path) - 6, "XXXXXX");
+
+		}
+
+		free(one);
+		free(merged);
+		free(partial);
+		sparsehash_plan_destroy(plan);
+
+	}
+
+	free(keys);
+
+}
+
+
+// sparsehash_dist_H_bounded and its one-vs-many form against sparsehash_dist_H: exact up to the bound, above it past
+static void check_bounded(const char *sketches, uint32_t num_sets, uint32_t m){
+
+	static const uint32_t bounds[] = {0, 50, 500, 1000, 2048};
+	uint32_t mbytes = (m+7)/8, *out, b, q, s, dist;
+
+
+	out = (uint32_t*) malloc(sizeof(uint32_t)*num_sets);
+
+	for (b=0; b<sizeof(bounds)/sizeof(bounds[0]); ++b){
+		for (q=0; q<num_sets; q+=97){
+			sparsehash_dist_H_bounded_many(sketches + (size_t)q*mbytes, sketches, num_sets, m, bounds[b], out);
+			for (s=0; s<num_sets; ++s){
+				dist = sparsehash_dist_H(sketches + (size_t)q*mbytes, sketches + (size_t)s*mbytes, m);
+				CHECK((dist <= bounds[b]) ? out[s] == dist : out[s] > bounds[b], "bounded distance of %u and %u with bound %u", q, s, bounds[b]);
+			}
+			s = (q*7+1) % num_sets;
+			dist = sparsehash_dist_H(sketches + (size_t)q*mbytes, sketches + (size_t)s*mbytes, m);
+			out[s] = sparsehash_dist_H_bounded(sketches + (size_t)q*mbytes, sketches + (size_t)s*mbytes, m, bounds[b]);
+			CHECK((dist <= bounds[b]) ? out[s] == dist : out[s] > bounds[b], "bounded distance of %u and %u with bound %u", q, s, bounds[b]);
+		}
+	}
+
+	free(out);
+
+}
+
+
+// Databases of 0, 1 and 37 records with every table round-trip, and corruption is caught
+static void check_db(const char *sketches, uint32_t m){
+
+	static const uint32_t counts[] = {0, 1, 37};
+	sparsehash_plan_t *plan, *medium, *exact;
+	sparsehash_db_writer_t *writer;
+	sparsehash_db_t *db;
+	char path[] = "/tmp/sparsehash_check_XXXXXX";
+	uint64_t ids[37];
+	uint32_t flags, c, r, n, mbytes = (m+7)/8;
+	int fd;
+
+
+	plan = sparsehash_plan_create(7, get_gamma(CHECK_SET_SIZE), m, SPARSEHASH_FAST);
+	medium = sparsehash_plan_create(7, get_gamma(CHECK_SET_SIZE), m, SPARSEHASH_MEDIUM);
+	exact = sparsehash_plan_create(7, get_gamma(CHECK_SET_SIZE), m, SPARSEHASH_EXACT);
+	fd = mkstemp(path);
+	CHECK(fd >= 0, "temporary file");
+	if (fd < 0)
+		return;
+	close(fd);
+	for (r=0; r<37; ++r)
+		ids[r] = 1000 + 3*(uint64_t)r;
+
+	for (flags=0; flags<=(SPARSEHASH_DB_IDS | SPARSEHASH_DB_POPCOUNTS); ++flags){
+		for (c=0; c<sizeof(counts)/sizeof(counts[0]); ++c){
+
+			n = counts[c];
+			writer = sparsehash_db_create(path, plan, flags);
+			CHECK(writer != NULL && sparsehash_db_append(writer, sketches, n, ids) == 0 && sparsehash_db_close(writer) == 0,
+				  "writing %u records with flags %u", n, flags);
+
+			db = sparsehash_db_map(path);
+			CHECK(db != NULL, "mapping %u records with flags %u", n, flags);
+			if (db == NULL)
+				continue;
+			CHECK(db->num_records == n && sparsehash_db_verify(db) == 0 && sparsehash_db_compatible(db, plan), "header of %u records with flags %u", n, flags);
+			CHECK(sparsehash_db_compatible(db, medium) && !sparsehash_db_compatible(db, exact), "variant class of %u records with flags %u", n, flags);
+			CHECK((db->ids != NULL) == ((flags & SPARSEHASH_DB_IDS) != 0) && (db->popcounts != NULL) == ((flags & SPARSEHASH_DB_POPCOUNTS) != 0),
+				  "tables of %u records with flags %u", n, flags);
+			for (r=0; r<db->num_records; ++r){
+				CHECK(memcmp(sparsehash_db_sketch(db, r), sketches + (size_t)r*mbytes, mbytes) == 0, "record %u of %u", r, n);
+				CHECK(db->ids == NULL || db->ids[r] == ids[r], "id of record %u of %u", r, n);
+				CHECK(db->popcounts == NULL || db->popcounts[r] == ones(sketches + (size_t)r*mbytes, m), "popcount of record %u of %u", r, n);
+			}
+			sparsehash_db_unmap(db);
+
+		}
+	}
+
+	// A flipped sketch byte fails the data checksum, a flipped header byte fails the map
+	CHECK(flip_byte(path, 200) == 0, "corrupting a record");
+	db = sparsehash_db_map(path);
+	CHECK(db != NULL && sparsehash_db_verify(db) != 0, "corrupt record not detected");
+	sparsehash_db_unmap(db);
+	CHECK(flip_byte(path, 20) == 0, "corrupting the header");
+	CHECK(sparsehash_db_map(path) == NULL, "corrupt header not detected");
+
+	unlink(path);
+	sparsehash_plan_destroy(plan);
+	sparsehash_plan_destroy(medium);
+	sparsehash_plan_destroy(exact);
+
+}
+
+
+// Cross-checks of the library against brute force, exit status 1 if any fails
+int main(void) {
+
+	char *sketches;
+	uint32_t num_sets;
+
+
+	check_hashes();
+	check_update();
+	check_batch();
+	check_planfile();
+	check_cli();
+	check_lookup();
+	check_merge();
+
+	sketches = clustered_sketches(CHECK_M, &num_sets);
+	// Also with a partial last byte, the stride is the same
+	check_allpairs(sketches, 300, CHECK_M);
+	check_allpairs(sketches, 300, CHECK_M-3);
+	check_topk(sketches, num_sets, CHECK_M);
+	check_index(sketches, num_sets, CHECK_M);
+	check_cascade(sketches, num_sets, CHECK_M);
+	check_bounded(sketches, num_sets, CHECK_M);
+	check_db(sketches, CHECK_M);
+	free(sketches);
+
+	if (failures > 0){
+		fprintf(stderr, "%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+
+	return 0;
+
+}
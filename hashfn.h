@@ -0,0 +1,133 @@
+#ifndef _HASHFN_H_
+#define _HASHFN_H_
+
+#include <stdint.h>
+#include <string.h>
+#include "MurmurHash3.h"
+
+
+// Hash function of the elements, selected per plan
+typedef enum{
+
+	SPARSEHASH_HASH_MURMUR3,	// first half of MurmurHash3_x64_128
+	SPARSEHASH_HASH_WYHASH		// wyhash-style multiply-fold, one 128-bit product per 8 bytes
+
+} sparsehash_hash_t;
+
+
+// Only the first 64 bits of the hashes are used. The fixed-width versions take 2, 4 or 8-byte keys
+// by value and return the same hash as the byte versions on the little-endian bytes of the key
+
+static inline uint64_t hashfn_fmix64(uint64_t k){
+
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdull;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ull;
+	k ^= k >> 33;
+
+	return k;
+
+}
+
+
+static inline uint64_t hashfn_murmur3_bytes(const void *key, int len, uint32_t seed){
+
+	uint64_t hash[2];
+
+
+	MurmurHash3_x64_128(key, len, seed, hash);
+
+	return hash[0];
+
+}
+
+
+// MurmurHash3_x64_128 of a key of at most 8 bytes: no body blocks and a single tail block
+static inline uint64_t hashfn_murmur3_fixed(uint64_t key, int len, uint32_t seed){
+
+	uint64_t h1, h2, k1 = key;
+
+
+	k1 *= 0x87c37b91114253d5ull;
+	k1 = (k1 << 31) | (k1 >> 33);
+	k1 *= 0x4cf5ad432745937full;
+
+	h1 = (uint64_t)seed ^ k1 ^ len;
+	h2 = (uint64_t)seed ^ len;
+
+	h1 += h2;
+	h2 += h1;
+
+	return hashfn_fmix64(h1) + hashfn_fmix64(h2);
+
+}
+
+
+#define WY_P0 0xa0761d6478bd642full
+#define WY_P1 0xe7037ed1a0b428dbull
+#define WY_P2 0x8ebc6af09c88c6e3ull
+
+// Fold of the 128-bit product
+static inline uint64_t hashfn_wymix(uint64_t a, uint64_t b){
+
+	__uint128_t r = (__uint128_t)a * b;
+
+	return (uint64_t)r ^ (uint64_t)(r >> 64);
+
+}
+
+
+// Up to 8 bytes, little-endian
+static inline uint64_t hashfn_read_part(const uint8_t *p, int len){
+
+	uint64_t v = 0;
+
+
+	memcpy(&v, p, len);
+
+	return v;
+
+}
+
+
+static inline uint64_t hashfn_wyhash_fixed(uint64_t key, int len, uint32_t seed){
+
+	uint64_t s = (uint64_t)seed ^ hashfn_wymix((uint64_t)seed ^ WY_P0, WY_P1);
+
+
+	return hashfn_wymix(WY_P1 ^ len, hashfn_wymix(key ^ WY_P1, s));
+
+}
+
+
+static inline uint64_t hashfn_wyhash_bytes(const void *key, int len, uint32_t seed){
+
+	const uint8_t *p = (const uint8_t*)key;
+	uint64_t s = (uint64_t)seed ^ hashfn_wymix((uint64_t)seed ^ WY_P0, WY_P1);
+	uint64_t a = 0, b = 0;
+	int i = len;
+
+
+	while (i > 16){
+		s = hashfn_wymix(hashfn_read_part(p, 8) ^ WY_P1, hashfn_read_part(p+8, 8) ^ s);
+		p += 16;
+		i -= 16;
+	}
+
+	if (i > 8){
+		a = hashfn_read_part(p, 8);
+		b = hashfn_read_part(p+8, i-8);
+	}
+	else
+		a = hashfn_read_part(p, i);
+
+	// Keys up to 8 bytes hash as in hashfn_wyhash_fixed
+	if (len > 8)
+		s = hashfn_wymix(b ^ WY_P2, s);
+
+	return hashfn_wymix(WY_P1 ^ len, hashfn_wymix(a ^ WY_P1, s));
+
+}
+
+#endif // _HASHFN_H_
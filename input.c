@@ -0,0 +1,182 @@
+#include "sparsehash.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+// Find the elements of a text mapping. Lines are sets when sets is nonzero, and their
+// whitespace-separated tokens the elements, otherwise every nonempty line is an element of one set.
+// With elems NULL only counts. 0 if successful, -1 if an element is too long
+static int input_scan(const char *text, size_t size, int sets, uint64_t *num_elements, uint32_t *num_sets, char **elems, uint16_t *lens, uint64_t *offsets){
+
+	const char *p = text, *end = text + size, *eol, *tok;
+	uint64_t n = 0;
+	uint32_t s = 0;
+	size_t len;
+
+
+	if (offsets != NULL)
+		offsets[0] = 0;
+
+	while (p < end){
+
+		eol = (const char*) memchr(p, '\n', end-p);
+		if (eol == NULL)
+			eol = end;
+
+		if (sets){
+			for (tok=p; tok<eol; ){
+				while (tok < eol && (*tok == ' ' || *tok == '\t' || *tok == '\r'))
+					tok++;
+				for (len=0; tok+len<eol && tok[len]!=' ' && tok[len]!='\t' && tok[len]!='\r'; ++len);
+				if (len == 0)
+					break;
+				if (len > UINT16_MAX)
+					return -1;
+				if (elems != NULL){
+					elems[n] = (char*)tok;
+					lens[n] = (uint16_t)len;
+				}
+				n++;
+				tok += len;
+			}
+			s++;
+			if (offsets != NULL)
+				offsets[s] = n;
+		}
+		else{
+			len = eol - p;
+			if (len > 0 && p[len-1] == '\r')
+				len--;
+			if (len > 0){
+				if (len > UINT16_MAX)
+					return -1;
+				if (elems != NULL){
+					elems[n] = (char*)p;
+					lens[n] = (uint16_t)len;
+				}
+				n++;
+			}
+		}
+
+		p = eol + 1;
+
+	}
+
+	if (!sets){
+		s = 1;
+		if (offsets != NULL)
+			offsets[1] = n;
+	}
+
+	*num_elements = n;
+	*num_sets = s;
+
+	return 0;
+
+}
+
+
+sparsehash_input_t* sparsehash_input_map(const char *path, sparsehash_format_t format){
+
+	sparsehash_input_t *in;
+	struct stat st;
+	int fd;
+	uint64_t num_elements;
+	uint32_t num_sets;
+
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) != 0){
+		close(fd);
+		return NULL;
+	}
+
+	in = (sparsehash_input_t*) calloc(1, sizeof(sparsehash_input_t));
+	if (in == NULL){
+		close(fd);
+		return NULL;
+	}
+
+	in->size = st.st_size;
+	if (in->size > 0){
+		in->map = mmap(NULL, in->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (in->map == MAP_FAILED){
+			in->map = NULL;
+			close(fd);
+			free(in);
+			return NULL;
+		}
+		// Read once from start to end
+		madvise(in->map, in->size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+
+	switch (format){
+
+		case SPARSEHASH_INPUT_U16 : in->element_size = 2; break;
+		case SPARSEHASH_INPUT_U32 : in->element_size = 4; break;
+		case SPARSEHASH_INPUT_U64 : in->element_size = 8; break;
+		default : in->element_size = 1; break;
+
+	}
+
+	in->offsets = (uint64_t*) malloc(sizeof(uint64_t)*2);
+	if (in->offsets == NULL){
+		sparsehash_input_unmap(in);
+		return NULL;
+	}
+
+	// Raw little-endian integers are used in place, one set per file
+	if (in->element_size > 1){
+		if (in->size % in->element_size != 0){
+			sparsehash_input_unmap(in);
+			return NULL;
+		}
+		in->data = in->map;
+		in->num_sets = 1;
+		in->offsets[0] = 0;
+		in->offsets[1] = in->size/in->element_size;
+		return in;
+	}
+
+	// Text, pointers and lengths into the mapping
+	if (input_scan((const char*)in->map, in->size, format == SPARSEHASH_INPUT_SETS, &num_elements, &num_sets, NULL, NULL, NULL) != 0){
+		sparsehash_input_unmap(in);
+		return NULL;
+	}
+
+	free(in->offsets);
+	in->offsets = (uint64_t*) malloc(sizeof(uint64_t)*((size_t)num_sets+1));
+	in->data = malloc(sizeof(char*)*(num_elements > 0 ? num_elements : 1));
+	in->str_len = (uint16_t*) malloc(sizeof(uint16_t)*(num_elements > 0 ? num_elements : 1));
+	if (in->offsets == NULL || in->data == NULL || in->str_len == NULL){
+		sparsehash_input_unmap(in);
+		return NULL;
+	}
+
+	input_scan((const char*)in->map, in->size, format == SPARSEHASH_INPUT_SETS, &num_elements, &num_sets, (char**)in->data, in->str_len, in->offsets);
+	in->num_sets = num_sets;
+
+	return in;
+
+}
+
+
+void sparsehash_input_unmap(sparsehash_input_t *in){
+
+	if (in == NULL)
+		return;
+
+	if (in->data != in->map)
+		free(in->data);
+	free(in->str_len);
+	free(in->offsets);
+	if (in->map != NULL)
+		munmap(in->map, in->size);
+	free(in);
+
+}
@@ -0,0 +1,623 @@
+#include "kernels.h"
+#include "simd.h"
+#include "stats.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+// Sketch kernels, specialized at compile time on the keys, the hash function and the search structure
+
+// Hashes per tile of the medium lookup, 16 KiB
+#define MEDIUM_TILE 2048
+
+// Fewest hashes per thread in the multithreaded fast lookup
+#define FAST_PARALLEL_MIN 16384
+
+// Hashes searched together in the Eytzinger layout
+#define EYTZ_GROUP 16
+
+
+// Keys: ptr and len give the bytes of key h, fixed-width keys are also hashed by value
+
+// Packed integers
+template<typename T> struct int_keys{
+
+	static const bool fixed_width = true;
+	const T *data;
+
+	inline uint64_t value(uint32_t h) const { return data[h]; }
+	inline const void* ptr(uint32_t h) const { return &(data[h]); }
+	inline int len(uint32_t) const { return sizeof(T); }
+
+};
+
+// Array of strings with their lengths
+struct string_keys{
+
+	static const bool fixed_width = false;
+	char * const *data;
+	const uint16_t *str_len;
+
+	inline uint64_t value(uint32_t) const { return 0; }
+	inline const void* ptr(uint32_t h) const { return data[h]; }
+	inline int len(uint32_t h) const { return str_len[h]; }
+
+};
+
+// Packed keys of N bytes
+template<int N> struct byte_keys{
+
+	static const bool fixed_width = false;
+	const uint8_t *data;
+
+	inline uint64_t value(uint32_t) const { return 0; }
+	inline const void* ptr(uint32_t h) const { return data + (size_t)h*N; }
+	inline int len(uint32_t) const { return N; }
+
+};
+
+// Packed keys of a size known at run time
+struct sized_keys{
+
+	static const bool fixed_width = false;
+	const uint8_t *data;
+	int size;
+
+	inline uint64_t value(uint32_t) const { return 0; }
+	inline const void* ptr(uint32_t h) const { return data + (size_t)h*size; }
+	inline int len(uint32_t) const { return size; }
+
+};
+
+
+// Hash functions: fixed-width, bytes, and one key under MURMUR_LANES seeds
+
+struct murmur3_hash{
+
+	static inline uint64_t fixed(uint64_t key, int len, uint32_t seed){ return hashfn_murmur3_fixed(key, len, seed); }
+	static inline uint64_t bytes(const void *key, int len, uint32_t seed){ return hashfn_murmur3_bytes(key, len, seed); }
+	static inline void lanes(const void *key, int len, const uint32_t *seeds, uint64_t *out){ MurmurHash3_x64_64_lanes(key, len, seeds, out); }
+
+};
+
+struct wyhash_hash{
+
+	static inline uint64_t fixed(uint64_t key, int len, uint32_t seed){ return hashfn_wyhash_fixed(key, len, seed); }
+	static inline uint64_t bytes(const void *key, int len, uint32_t seed){ return hashfn_wyhash_bytes(key, len, seed); }
+	static inline void lanes(const void *key, int len, const uint32_t *seeds, uint64_t *out){
+		for (int l = 0; l < MURMUR_LANES; l++)
+			out[l] = hashfn_wyhash_bytes(key, len, seeds[l]);
+	}
+
+};
+
+
+template<class Hash, class Keys>
+static inline uint64_t hash_key(const Keys &keys, uint32_t h, uint32_t seed){
+
+	if (Keys::fixed_width)
+		return Hash::fixed(keys.value(h), keys.len(h), seed);
+
+	return Hash::bytes(keys.ptr(h), keys.len(h), seed);
+
+}
+
+
+// Exact version, every element is hashed with the seed of every measurement until one is below tau.
+// Measurements are processed MURMUR_LANES at a time, hashing each element under all their seeds at once
+template<class Hash, class Keys>
+static void sparsehash_compute_exact(const Keys &keys, uint32_t num_elements, const sparsehash_plan_t *plan, char *out){
+
+	uint32_t blk, nblocks;
+
+
+	nblocks = (plan->m + MURMUR_LANES-1)/MURMUR_LANES;
+
+	STATS_CALLER(acc);
+	#pragma omp parallel for schedule(dynamic)
+	for (blk = 0; blk < nblocks; blk++) { 
+
+		uint32_t h, i, l, ibyte, lanes, done, all;
+		uint32_t seeds[MURMUR_LANES];
+		uint64_t hash[MURMUR_LANES];
+
+		// Pad the last block with copies of the last seed
+		lanes = (plan->m - blk*MURMUR_LANES < MURMUR_LANES) ? plan->m - blk*MURMUR_LANES : MURMUR_LANES;
+		for (l = 0; l < MURMUR_LANES; l++)
+			seeds[l] = plan->seeds[blk*MURMUR_LANES + ((l < lanes) ? l : lanes-1)];
+
+		// Measurements already set, by an earlier update of the sketch, need no hashing
+		done = 0;
+		for (l = 0; l < lanes; l++)
+			done |= (uint32_t)(((uint8_t)out[blk] >> (7-l)) & 1) << l;
+		all = (1u << lanes)-1;
+
+		for ( h=0; h<num_elements && done != all; h++) {
+
+			Hash::lanes( keys.ptr(h), keys.len(h), seeds, hash );
+			for (l = 0; l < lanes; l++) {
+				if (hash[l] < plan->tau && ((done >> l) & 1) == 0) {
+					i = blk*MURMUR_LANES + l;
+					ibyte = i/8;
+					out[ibyte] =  out[ibyte] | ( (0x80) >> (i%8) );
+					done |= 1u << l;
+				}
+			}
+
+		}
+
+		STATS_ADD(hashes, (uint64_t)h*lanes);
+		STATS_FOLD(acc);
+
+	}
+	STATS_JOIN(acc);
+
+}
+
+
+// Single hash of every element, used by the medium and fast versions.
+// Fixed-width keys are hashed by value, with no length-driven loops
+template<class Hash, class Keys>
+static void sparsehash_compute_hashes(const Keys &keys, uint32_t num_elements, uint32_t seed, uint64_t *hashes){
+
+	uint32_t h;
+
+
+	#pragma omp parallel for private(h)
+	for ( h=0; h<num_elements; ++h)
+		hashes[h] = hash_key<Hash>(keys, h, seed);
+
+	STATS_ADD(hashes, num_elements);
+
+}
+
+
+// Medium-speed lookup, every interval is compared with every hash. Measurements are processed 64 at a
+// time against L1-sized tiles of hashes, with vectorized compares, and each block of 64 bits is written once
+static void sparsehash_lookup_medium(const uint64_t *hashes, uint32_t num_elements, const sparsehash_plan_t *plan, char *out){
+
+	uint32_t blk, nblocks;
+	const uint64_t *bot = plan->bot;
+	const uint64_t *top = plan->top;
+
+
+	nblocks = (plan->m + 63)/64;
+
+	STATS_CALLER(acc);
+	#pragma omp parallel for schedule(dynamic)
+	for (blk = 0; blk < nblocks; ++blk) { 
+
+		uint32_t i, first, last, t, len, ibyte;
+		uint64_t hit = 0, full;
+		uint8_t bits;
+
+		first = 64*blk;
+		last = (first+64 < plan->m) ? first+64 : plan->m;
+		full = (last-first == 64) ? ~0ull : (1ull << (last-first))-1;
+
+		// Stop as soon as all the measurements of the block are set
+		for (t = 0; t < num_elements && hit != full; t += MEDIUM_TILE) {
+
+			len = (num_elements-t < MEDIUM_TILE) ? num_elements-t : MEDIUM_TILE;
+
+			for (i = first; i < last; ++i) {
+				if (((hit >> (i-first)) & 1) == 0) {
+					STATS_ADD(windows, 1);
+					if (simd_window_any(hashes+t, len, bot[i], top[i]-bot[i]))
+						hit |= 1ull << (i-first);
+				}
+			}
+
+		}
+
+		// Blocks start on a byte boundary, bit 0x80 is the first measurement of a byte
+		for (ibyte = first/8; 8*ibyte < last; ++ibyte) {
+			bits = 0;
+			for (i = 8*ibyte; i < 8*ibyte+8 && i < last; ++i)
+				bits |= ((hit >> (i-first)) & 1) << (7-i%8);
+			out[ibyte] |= bits;
+		}
+
+		STATS_FOLD(acc);
+
+	}
+	STATS_JOIN(acc);
+
+}
+
+
+// Set measurement hit, whose interval contains hash, and the overlapping intervals around it
+static inline void sparsehash_set_overlaps(uint64_t hash, uint32_t hit, const sparsehash_plan_t *plan, char *out){
+
+	uint32_t ibyte, meas;
+
+
+	ibyte = hit/8;
+	out[ibyte] =  out[ibyte] | ( (0x80) >> (hit%8) );
+
+	// check right for overlap, is it still above bot?
+	for(meas=hit+1; (meas<plan->m) && (hash >= plan->bot[meas]); meas++){
+		STATS_ADD(overlap_scanned, 1);
+		ibyte = meas/8;
+		out[ibyte] =  out[ibyte] | ( (0x80) >> (meas%8) );
+	}
+
+	// check left for overlap, is it still below top?
+	for(meas=hit; (meas>0) && (hash < plan->top[meas-1]); meas--){
+		STATS_ADD(overlap_scanned, 1);
+		ibyte = (meas-1)/8;
+		out[ibyte] =  out[ibyte] | ( (0x80) >> ((meas-1)%8) );
+	}
+
+}
+
+
+// Search structures used one hash at a time, find returns the measurement containing hash or m if none.
+
+// Traverse the tree of the sorted intervals
+struct search_tree{
+
+	static inline uint32_t find(uint64_t hash, const sparsehash_plan_t *plan){
+
+		const bst_t *ptr;
+
+
+		ptr = plan->head;
+		while(ptr!=NULL){
+			STATS_ADD(nodes_visited, 1);
+			if(hash < ptr->botVal)
+				ptr = ptr->leftPtr;
+			else{
+				if(hash < ptr->topVal)
+					return ptr->measNo;
+				else
+					ptr = ptr->rightPtr;
+			}
+		}
+
+		return plan->m;
+
+	}
+
+};
+
+
+// Same descent as the tree, with the midpoints computed on the sorted arrays
+struct search_binary{
+
+	static inline uint32_t find(uint64_t hash, const sparsehash_plan_t *plan){
+
+		uint32_t lo = 0, hi = plan->m, mid;
+
+
+		while(lo<hi){
+			STATS_ADD(nodes_visited, 1);
+			mid = lo + (hi-1-lo)/2;
+			if(hash < plan->bot[mid])
+				hi = mid;
+			else{
+				if(hash < plan->top[mid])
+					return mid;
+				else
+					lo = mid+1;
+			}
+		}
+
+		return plan->m;
+
+	}
+
+};
+
+
+// Direct address of the bucket of hash, then a scan of the bottoms in it
+struct search_bucket{
+
+	static inline uint32_t find(uint64_t hash, const sparsehash_plan_t *plan){
+
+		uint32_t i, end;
+		uint64_t b = hash >> (64-plan->bucket_bits);
+
+
+		i = plan->bucket_first[b];
+		end = plan->bucket_first[b+1];
+		while (i<end && plan->bot[i] <= hash)
+			i++;
+		STATS_ADD(nodes_visited, i+1-plan->bucket_first[b]);
+
+		// Largest bottom not above hash, it may also come from a previous bucket
+		if (i > 0 && hash < plan->top[i-1])
+			return i-1;
+
+		return plan->m;
+
+	}
+
+};
+
+
+// Branchless descent of the Eytzinger layout for EYTZ_GROUP hashes at a time, so that their cache
+// misses overlap, prefetching the line of the descendants 3 levels down. Sets hit[j] as the search functions
+static inline void sparsehash_search_eytzinger(const uint64_t *hash, uint32_t *hit, const sparsehash_plan_t *plan){
+
+	uint32_t k[EYTZ_GROUP];
+	uint32_t j, level, pos;
+	const uint64_t *eytz = plan->eytz_bot;
+
+
+	for (j=0; j<EYTZ_GROUP; ++j)
+		k[j] = 1;
+
+	// Levels above the last one are complete
+	for (level=0; ((uint64_t)2<<level)-1 <= plan->m; ++level){
+		for (j=0; j<EYTZ_GROUP; ++j){
+			__builtin_prefetch(eytz + 8*(uint64_t)k[j]);
+			k[j] = 2*k[j] + (eytz[k[j]] <= hash[j]);
+		}
+	}
+	STATS_ADD(nodes_visited, (uint64_t)EYTZ_GROUP*level);
+	for (j=0; j<EYTZ_GROUP; ++j){
+		if (k[j] <= plan->m){
+			STATS_ADD(nodes_visited, 1);
+			k[j] = 2*k[j] + (eytz[k[j]] <= hash[j]);
+		}
+	}
+
+	for (j=0; j<EYTZ_GROUP; ++j){
+		// Undo the right turns taken after the last left turn, k is the first bottom above hash
+		k[j] >>= __builtin_ffs(~k[j]);
+		// Largest bottom not above hash, it has the largest top of the intervals starting below hash
+		pos = plan->eytz_idx[k[j]];
+		hit[j] = (pos > 0 && hash[j] < plan->top[pos-1]) ? pos-1 : plan->m;
+	}
+
+}
+
+
+// Sort and deduplicate the hashes, then merge them with the sorted intervals in a single sweep.
+// Interval i is hit iff the first hash not below its bottom is below its top. -1 if the sort buffer cannot be allocated
+static int sparsehash_lookup_sweep(uint64_t *hashes, uint32_t num_elements, const sparsehash_plan_t *plan, char *out){
+
+	uint32_t i, j, u, ibyte;
+	uint64_t *tmp, *sorted;
+	uint8_t bits;
+
+
+	tmp = (uint64_t*)malloc(sizeof(uint64_t)*num_elements);
+	if (tmp == NULL)
+		return -1;
+	sorted = radixSort(hashes, tmp, num_elements);
+	u = uniqueSorted(sorted, num_elements);
+
+	// Bits of a byte are gathered before touching out
+	j = 0;
+	for (ibyte=0; ibyte<plan->mbytes; ++ibyte){
+
+		bits = 0;
+		for (i=8*ibyte; i<8*ibyte+8 && i<plan->m; ++i){
+			while (j<u && sorted[j] < plan->bot[i])
+				j++;
+			if (j<u && sorted[j] < plan->top[i])
+				bits |= (0x80) >> (i%8);
+		}
+		out[ibyte] |= bits;
+
+		// Remaining intervals start above the last hash
+		if (j == u)
+			break;
+
+	}
+
+	STATS_ADD(searches, num_elements);
+	STATS_ADD(nodes_visited, (8*ibyte+8 < plan->m) ? 8*ibyte+8 : plan->m);
+	free(tmp);
+
+	return 0;
+
+}
+
+
+// Lookup with a search structure used one hash at a time
+template<class Search>
+static void sparsehash_lookup_search(const uint64_t *hashes, uint32_t num_elements, const sparsehash_plan_t *plan, char *out){
+
+	uint32_t h, hit;
+
+
+	for ( h=0; h<num_elements; ++h){
+		hit = Search::find(hashes[h], plan);
+		if (hit < plan->m){
+			STATS_ADD(hits, 1);
+			sparsehash_set_overlaps(hashes[h], hit, plan, out);
+		}
+	}
+
+	STATS_ADD(searches, num_elements);
+
+}
+
+
+static void sparsehash_lookup_eytzinger(const uint64_t *hashes, uint32_t num_elements, const sparsehash_plan_t *plan, char *out){
+
+	uint32_t h, j;
+	uint32_t hits[EYTZ_GROUP];
+	uint64_t group[EYTZ_GROUP];
+
+
+	for ( h=0; h<num_elements; h+=EYTZ_GROUP){
+		// Pad the last group with copies of the last hash
+		for (j=0; j<EYTZ_GROUP; ++j)
+			group[j] = hashes[(h+j < num_elements) ? h+j : num_elements-1];
+		sparsehash_search_eytzinger(group, hits, plan);
+		for (j=0; j<EYTZ_GROUP; ++j){
+			if (hits[j] < plan->m){
+				STATS_ADD(hits, h+j < num_elements);
+				sparsehash_set_overlaps(group[j], hits[j], plan, out);
+			}
+		}
+	}
+
+	STATS_ADD(searches, num_elements);
+
+}
+
+
+// Fast lookup on one thread, every hash searches the sorted intervals. hashes may be reordered
+static void sparsehash_lookup_fast_serial(uint64_t *hashes, uint32_t num_elements, const sparsehash_plan_t *plan, char *out){
+
+	switch (plan->lookup){
+
+		case SPARSEHASH_LOOKUP_TREE : sparsehash_lookup_search<search_tree>(hashes, num_elements, plan, out); break;
+		case SPARSEHASH_LOOKUP_BINARY : sparsehash_lookup_search<search_binary>(hashes, num_elements, plan, out); break;
+		case SPARSEHASH_LOOKUP_BUCKET : sparsehash_lookup_search<search_bucket>(hashes, num_elements, plan, out); break;
+		case SPARSEHASH_LOOKUP_EYTZINGER : sparsehash_lookup_eytzinger(hashes, num_elements, plan, out); break;
+		case SPARSEHASH_LOOKUP_SWEEP :
+			// Same sketch with the binary search, which needs no memory
+			if (sparsehash_lookup_sweep(hashes, num_elements, plan, out) != 0)
+				sparsehash_lookup_search<search_binary>(hashes, num_elements, plan, out);
+			break;
+
+	}
+
+}
+
+
+// Fast lookup, hashes are split among threads that set bits in private bitmaps, OR-ed into out at the end
+static void sparsehash_lookup_fast(uint64_t *hashes, uint32_t num_elements, const sparsehash_plan_t *plan, char *out){
+
+	uint32_t nthreads = 1;
+	size_t stride;
+	uint64_t *priv;
+
+
+	// Enough elements per thread to pay for a private bitmap, no nesting inside sparsehash_sketch_batch
+#ifdef _OPENMP
+	if (!omp_in_parallel()){
+		nthreads = omp_get_max_threads();
+		if (nthreads > num_elements/FAST_PARALLEL_MIN)
+			nthreads = num_elements/FAST_PARALLEL_MIN;
+	}
+#endif
+
+	if (nthreads <= 1){
+		sparsehash_lookup_fast_serial(hashes, num_elements, plan, out);
+		return;
+	}
+
+	// Bitmaps padded to whole cache lines, in 64-bit words
+	stride = ((plan->mbytes + 63)/64)*8;
+	if (posix_memalign((void**)&priv, 64, sizeof(uint64_t)*stride*nthreads) != 0){
+		sparsehash_lookup_fast_serial(hashes, num_elements, plan, out);
+		return;
+	}
+
+	STATS_CALLER(acc);
+	#pragma omp parallel num_threads(nthreads)
+	{
+
+		uint32_t t, nt, begin, end, k;
+		size_t w, wbegin, wend, b;
+		uint64_t *mine;
+
+#ifdef _OPENMP
+		t = omp_get_thread_num();
+		nt = omp_get_num_threads();
+#else
+		t = 0;
+		nt = 1;
+#endif
+
+		mine = priv + t*stride;
+		memset(mine, 0, sizeof(uint64_t)*stride);
+
+		begin = ((uint64_t)num_elements*t)/nt;
+		end = ((uint64_t)num_elements*(t+1))/nt;
+		sparsehash_lookup_fast_serial(hashes+begin, end-begin, plan, (char*)mine);
+
+		#pragma omp barrier
+
+		// Each thread reduces a slice of the words into the first bitmap and then into out,
+		// both loops are over contiguous words and vectorize
+		wbegin = (stride*t)/nt;
+		wend = (stride*(t+1))/nt;
+		for (k=1; k<nt; ++k){
+			for (w=wbegin; w<wend; ++w)
+				priv[w] |= priv[k*stride+w];
+		}
+		for (b=8*wbegin; b<8*wend && b<plan->mbytes; ++b)
+			out[b] |= ((char*)priv)[b];
+
+		STATS_FOLD(acc);
+
+	}
+	STATS_JOIN(acc);
+
+	free(priv);
+
+}
+
+
+template<class Hash, class Keys>
+static void sparsehash_compute(const Keys &keys, uint32_t num_elements, const sparsehash_plan_t *plan, uint64_t *hashes, char *out){
+
+	STATS_START(t_hash);
+
+	if (plan->variant == SPARSEHASH_EXACT){
+		sparsehash_compute_exact<Hash>(keys, num_elements, plan, out);
+		STATS_STOP(SPARSEHASH_PHASE_HASH, t_hash);
+		return;
+	}
+
+	sparsehash_compute_hashes<Hash>(keys, num_elements, plan->hash_seed, hashes);
+	STATS_STOP(SPARSEHASH_PHASE_HASH, t_hash);
+
+	STATS_START(t_lookup);
+	if (plan->variant == SPARSEHASH_MEDIUM)
+		sparsehash_lookup_medium(hashes, num_elements, plan, out);
+	else
+		sparsehash_lookup_fast(hashes, num_elements, plan, out);
+	STATS_STOP(SPARSEHASH_PHASE_LOOKUP, t_lookup);
+
+}
+
+
+// One instantiation per key type, common identifier sizes get their own byte-key kernels
+template<class Hash>
+static void sparsehash_kernel_keys(const sparsehash_plan_t *plan, const void *data, uint32_t num_elements, uint32_t key_size, const uint16_t *str_len, uint64_t *hashes, char *out){
+
+	switch (key_size){
+
+		case 0 : { string_keys keys = { (char * const *)data, str_len }; sparsehash_compute<Hash>(keys, num_elements, plan, hashes, out); break; }
+		case 1 : { int_keys<uint8_t> keys = { (const uint8_t*)data }; sparsehash_compute<Hash>(keys, num_elements, plan, hashes, out); break; }
+		case 2 : { int_keys<uint16_t> keys = { (const uint16_t*)data }; sparsehash_compute<Hash>(keys, num_elements, plan, hashes, out); break; }
+		case 4 : { int_keys<uint32_t> keys = { (const uint32_t*)data }; sparsehash_compute<Hash>(keys, num_elements, plan, hashes, out); break; }
+		case 8 : { int_keys<uint64_t> keys = { (const uint64_t*)data }; sparsehash_compute<Hash>(keys, num_elements, plan, hashes, out); break; }
+		case 12 : { byte_keys<12> keys = { (const uint8_t*)data }; sparsehash_compute<Hash>(keys, num_elements, plan, hashes, out); break; }
+		case 16 : { byte_keys<16> keys = { (const uint8_t*)data }; sparsehash_compute<Hash>(keys, num_elements, plan, hashes, out); break; }
+		case 20 : { byte_keys<20> keys = { (const uint8_t*)data }; sparsehash_compute<Hash>(keys, num_elements, plan, hashes, out); break; }
+		case 32 : { byte_keys<32> keys = { (const uint8_t*)data }; sparsehash_compute<Hash>(keys, num_elements, plan, hashes, out); break; }
+		default : { sized_keys keys = { (const uint8_t*)data, (int)key_size }; sparsehash_compute<Hash>(keys, num_elements, plan, hashes, out); break; }
+
+	}
+
+}
+
+
+void sparsehash_kernel(const sparsehash_plan_t *plan, const void *data, uint32_t num_elements, uint32_t key_size, const uint16_t *str_len, uint64_t *hashes, char *out){
+
+	STATS_ONLY(uint64_t before = simd_popcount_union((const uint8_t*)out, (const uint8_t*)out, plan->mbytes));
+
+
+	switch (plan->hash){
+
+		case SPARSEHASH_HASH_MURMUR3 : sparsehash_kernel_keys<murmur3_hash>(plan, data, num_elements, key_size, str_len, hashes, out); break;
+		case SPARSEHASH_HASH_WYHASH : sparsehash_kernel_keys<wyhash_hash>(plan, data, num_elements, key_size, str_len, hashes, out); break;
+
+	}
+
+	STATS_ADD(calls, 1);
+	STATS_ADD(elements, num_elements);
+	STATS_ADD(bits_set, simd_popcount_union((const uint8_t*)out, (const uint8_t*)out, plan->mbytes) - before);
+
+}
@@ -0,0 +1,12 @@
+#ifndef _KERNELS_H_
+#define _KERNELS_H_
+
+#include "sparsehash.h"
+
+
+// Sketch num_elements keys with plan into out (already zeroed). key_size 0 is an array of strings with
+// lengths str_len, other sizes are packed keys of key_size bytes; keys of 1, 2, 4 and 8 bytes are integers.
+// hashes is scratch space for num_elements hashes, unused by the exact version
+void sparsehash_kernel(const sparsehash_plan_t *plan, const void *data, uint32_t num_elements, uint32_t key_size, const uint16_t *str_len, uint64_t *hashes, char *out);
+
+#endif // _KERNELS_H_
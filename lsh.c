@@ -0,0 +1,429 @@
+#include "sparsehash.h"
+
+
+// Largest band, band values are kept in 64 bits
+#define LSH_MAX_ROWS 64
+
+// Most bands considered by sparsehash_lsh_params, every band costs one table
+#define LSH_MAX_BANDS 512
+
+// Points of the integrals of sparsehash_lsh_params
+#define LSH_STEPS 100
+
+// Spreads the bands over the buckets
+#define LSH_BAND_MULT 0x9e3779b97f4a7c15ull
+
+
+// Probability that a bit agrees in the sketches of two sets of equal size with Jaccard J,
+// each bit being 1 with probability 1/2 as with get_gamma
+static double lsh_bit_agree(double J){
+
+	return pow(2.0, (J-1)/(J+1));
+
+}
+
+
+int sparsehash_lsh_params(double threshold, uint32_t m, uint32_t *bands, uint32_t *rows){
+
+	double p[LSH_STEPS+1], fp, fn, err, best = INFINITY;
+	uint32_t b, r, i, max_rows;
+
+
+	if (m == 0 || !(threshold > 0 && threshold < 1))
+		return -1;
+
+	for (i=0; i<=LSH_STEPS; ++i)
+		p[i] = lsh_bit_agree((double)i/LSH_STEPS);
+
+	// Smallest sum of the false positive and false negative areas under the collision curve
+	max_rows = (m < LSH_MAX_ROWS) ? m : LSH_MAX_ROWS;
+	for (r=1; r<=max_rows; ++r){
+		for (b=1; b<=LSH_MAX_BANDS && (uint64_t)b*r<=m; ++b){
+			fp = fn = 0;
+			for (i=0; i<=LSH_STEPS; ++i){
+				double collide = 1 - pow(1 - pow(p[i], r), b);
+				if ((double)i/LSH_STEPS < threshold)
+					fp += collide;
+				else
+					fn += 1 - collide;
+			}
+			err = (fp + fn)/LSH_STEPS;
+			if (err < best){
+				best = err;
+				*bands = b;
+				*rows = r;
+			}
+		}
+	}
+
+	return 0;
+
+}
+
+
+static sparsehash_lsh_t* lsh_alloc(uint32_t m, uint32_t bands, uint32_t rows){
+
+	sparsehash_lsh_t *lsh;
+
+
+	lsh = (sparsehash_lsh_t*) calloc(1, sizeof(sparsehash_lsh_t));
+	if (lsh == NULL)
+		return NULL;
+
+	lsh->m = m;
+	lsh->mbytes = (m+7)/8;
+	lsh->bands = bands;
+	lsh->rows = rows;
+
+	return lsh;
+
+}
+
+
+sparsehash_lsh_t* sparsehash_lsh_create(uint32_t m, uint32_t bands, uint32_t rows){
+
+	if (bands == 0 || rows == 0 || rows > LSH_MAX_ROWS || (uint64_t)bands*rows > m)
+		return NULL;
+
+	return lsh_alloc(m, bands, rows);
+
+}
+
+
+uint32_t sparsehash_mih_substrings(uint32_t m, uint32_t num_sketches){
+
+	uint32_t bits = 1, substrings;
+
+
+	// Substrings of about log2(num_sketches) bits leave about one sketch per bucket
+	while (bits < LSH_MAX_ROWS && ((uint64_t)1 << bits) < num_sketches)
+		bits++;
+
+	substrings = (m + bits - 1)/bits;
+	return (substrings > 0) ? substrings : 1;
+
+}
+
+
+sparsehash_mih_t* sparsehash_mih_create(uint32_t m, uint32_t substrings){
+
+	uint32_t rows;
+
+
+	if (substrings == 0 || substrings > m)
+		return NULL;
+
+	// Every bit is in a substring, the last substrings may be one bit shorter
+	rows = (m + substrings - 1)/substrings;
+	if (rows > LSH_MAX_ROWS)
+		return NULL;
+
+	return lsh_alloc(m, substrings, rows);
+
+}
+
+
+void sparsehash_lsh_destroy(sparsehash_lsh_t *lsh){
+
+	if (lsh == NULL)
+		return;
+
+	free(lsh->sketches);
+	free(lsh->keys);
+	free(lsh->next);
+	free(lsh->head);
+	free(lsh);
+
+}
+
+
+// Bits band, band+bands, band+2*bands... of sketch. Intervals are sorted, so nearby measurements overlap
+// and are correlated, while bits bands apart are close to independent
+static inline uint64_t lsh_band(const sparsehash_lsh_t *lsh, const char *sketch, uint32_t band){
+
+	uint32_t r, bit;
+	uint64_t value = 0;
+
+
+	for (r=0, bit=band; r<lsh->rows && bit<lsh->m; ++r, bit+=lsh->bands)
+		value = (value << 1) | ( ((uint8_t)sketch[bit/8] >> (7 - bit%8)) & 1 );
+
+	return value;
+
+}
+
+
+static inline uint64_t lsh_bucket(const sparsehash_lsh_t *lsh, uint64_t key, uint32_t band){
+
+	return hashfn_fmix64(key + (band+1)*LSH_BAND_MULT) >> (64 - lsh->table_bits);
+
+}
+
+
+// Link sketch id in the chains of its buckets
+static inline void lsh_link(sparsehash_lsh_t *lsh, uint32_t id){
+
+	uint32_t band;
+	uint64_t bucket;
+
+
+	for (band=0; band<lsh->bands; ++band){
+		bucket = (uint64_t)band << lsh->table_bits | lsh_bucket(lsh, lsh->keys[(size_t)id*lsh->bands + band], band);
+		lsh->next[(size_t)id*lsh->bands + band] = lsh->head[bucket];
+		lsh->head[bucket] = id;
+	}
+
+}
+
+
+// Room for num_sketches sketches, the tables are rebuilt when they grow
+static int lsh_reserve(sparsehash_lsh_t *lsh, uint32_t num_sketches){
+
+	uint32_t capacity, table_bits, id;
+	void *p;
+
+
+	if (num_sketches > lsh->capacity){
+
+		capacity = (lsh->capacity > 0) ? lsh->capacity : 1024;
+		while (capacity < num_sketches)
+			capacity = (capacity > UINT32_MAX/2) ? UINT32_MAX : 2*capacity;
+
+		if ( (p = realloc(lsh->sketches, (size_t)capacity*lsh->mbytes)) == NULL )
+			return -1;
+		lsh->sketches = (char*)p;
+		if ( (p = realloc(lsh->keys, sizeof(uint64_t)*capacity*lsh->bands)) == NULL )
+			return -1;
+		lsh->keys = (uint64_t*)p;
+		if ( (p = realloc(lsh->next, sizeof(uint32_t)*capacity*lsh->bands)) == NULL )
+			return -1;
+		lsh->next = (uint32_t*)p;
+		lsh->capacity = capacity;
+
+	}
+
+	// About one bucket per sketch in every band
+	table_bits = 10;
+	while (table_bits < 32 && ((uint64_t)1 << table_bits) < num_sketches)
+		table_bits++;
+
+	if (table_bits != lsh->table_bits){
+		p = malloc(sizeof(uint32_t) * ((size_t)lsh->bands << table_bits));
+		if (p == NULL)
+			return -1;
+		free(lsh->head);
+		lsh->head = (uint32_t*)p;
+		lsh->table_bits = table_bits;
+		memset(lsh->head, 0xFF, sizeof(uint32_t) * ((size_t)lsh->bands << table_bits));
+		for (id=0; id<lsh->num_sketches; ++id)
+			lsh_link(lsh, id);
+	}
+
+	return 0;
+
+}
+
+
+int64_t sparsehash_lsh_insert(sparsehash_lsh_t *lsh, const char *sketches, uint32_t num_sketches){
+
+	uint32_t first = lsh->num_sketches, id, band;
+
+
+	if ((uint64_t)first + num_sketches >= UINT32_MAX || lsh_reserve(lsh, first + num_sketches) != 0)
+		return -1;
+
+	memcpy(lsh->sketches + (size_t)first*lsh->mbytes, sketches, (size_t)num_sketches*lsh->mbytes);
+
+	#pragma omp parallel for private(id, band)
+	for (id=first; id<first+num_sketches; ++id){
+		for (band=0; band<lsh->bands; ++band)
+			lsh->keys[(size_t)id*lsh->bands + band] = lsh_band(lsh, lsh->sketches + (size_t)id*lsh->mbytes, band);
+	}
+
+	for (id=first; id<first+num_sketches; ++id)
+		lsh_link(lsh, id);
+	lsh->num_sketches = first + num_sketches;
+
+	return first;
+
+}
+
+
+static int cmpneighbor(const void *a, const void *b){
+
+	const sparsehash_neighbor_t *na = (const sparsehash_neighbor_t*)a, *nb = (const sparsehash_neighbor_t*)b;
+
+	if (na->dist != nb->dist)
+		return (na->dist > nb->dist) - (na->dist < nb->dist);
+	return (na->index > nb->index) - (na->index < nb->index);
+
+}
+
+
+static int cmpid(const void *a, const void *b){
+
+	uint32_t ia = *(const uint32_t*)a, ib = *(const uint32_t*)b;
+	return (ia > ib) - (ia < ib);
+
+}
+
+
+// Append the stored sketches whose band value is key
+static int lsh_collect(const sparsehash_lsh_t *lsh, uint32_t band, uint64_t key, uint32_t **candidates, uint32_t *num_candidates, uint32_t *size){
+
+	uint32_t id, *p;
+	uint64_t bucket;
+
+
+	bucket = (uint64_t)band << lsh->table_bits | lsh_bucket(lsh, key, band);
+	for (id=lsh->head[bucket]; id!=UINT32_MAX; id=lsh->next[(size_t)id*lsh->bands + band]){
+		if (lsh->keys[(size_t)id*lsh->bands + band] != key)
+			continue;
+		if (*num_candidates == *size){
+			p = (uint32_t*) realloc(*candidates, sizeof(uint32_t)*2*(*size));
+			if (p == NULL)
+				return -1;
+			*candidates = p;
+			*size *= 2;
+		}
+		(*candidates)[(*num_candidates)++] = id;
+	}
+
+	return 0;
+
+}
+
+
+// Verify the candidates, sketches colliding in several bands once. by_sim keeps Jaccard estimates
+// at least threshold, otherwise Hamming distances at most radius
+static int64_t lsh_verify(const sparsehash_lsh_t *lsh, const char *sketch, uint32_t *candidates, uint32_t num_candidates, int by_sim, double threshold, uint32_t radius, sparsehash_neighbor_t **out){
+
+	uint32_t c, id, num_out = 0;
+	sparsehash_neighbor_t *neighbors;
+	const char *stored;
+
+
+	qsort(candidates, num_candidates, sizeof(uint32_t), cmpid);
+	for (c=0, id=0; c<num_candidates; ++c){
+		if (c == 0 || candidates[c] != candidates[c-1])
+			candidates[id++] = candidates[c];
+	}
+	num_candidates = id;
+
+	neighbors = (sparsehash_neighbor_t*) malloc(sizeof(sparsehash_neighbor_t)*(num_candidates > 0 ? num_candidates : 1));
+	if (neighbors == NULL)
+		return -1;
+
+	for (c=0; c<num_candidates; ++c){
+		stored = lsh->sketches + (size_t)candidates[c]*lsh->mbytes;
+		if (by_sim){
+			neighbors[num_out].sim = sparsehash_sim_J(sketch, stored, lsh->m);
+			if (!(neighbors[num_out].sim >= threshold))
+				continue;
+			neighbors[num_out].dist = sparsehash_dist_H(sketch, stored, lsh->m);
+		}
+		else{
+			neighbors[num_out].dist = sparsehash_dist_H_bounded(sketch, stored, lsh->m, radius);
+			if (neighbors[num_out].dist > radius)
+				continue;
+			neighbors[num_out].sim = sparsehash_sim_J(sketch, stored, lsh->m);
+		}
+		neighbors[num_out].index = candidates[c];
+		num_out++;
+	}
+
+	qsort(neighbors, num_out, sizeof(sparsehash_neighbor_t), cmpneighbor);
+	*out = neighbors;
+
+	return num_out;
+
+}
+
+
+int64_t sparsehash_lsh_query(const sparsehash_lsh_t *lsh, const char *sketch, double threshold, sparsehash_neighbor_t **out){
+
+	uint32_t band, num_candidates = 0, size = 64;
+	uint32_t *candidates;
+	int64_t num_out;
+
+
+	*out = NULL;
+	if (lsh->num_sketches == 0)
+		return 0;
+
+	candidates = (uint32_t*) malloc(sizeof(uint32_t)*size);
+	if (candidates == NULL)
+		return -1;
+
+	// Sketches colliding in some band
+	for (band=0; band<lsh->bands; ++band){
+		if (lsh_collect(lsh, band, lsh_band(lsh, sketch, band), &candidates, &num_candidates, &size) != 0){
+			free(candidates);
+			return -1;
+		}
+	}
+
+	num_out = lsh_verify(lsh, sketch, candidates, num_candidates, 1, threshold, 0, out);
+	free(candidates);
+
+	return num_out;
+
+}
+
+
+int64_t sparsehash_mih_query(const sparsehash_mih_t *mih, const char *sketch, uint32_t radius, sparsehash_neighbor_t **out){
+
+	uint32_t band, len, weight, num_candidates = 0, size = 64;
+	uint32_t sub_radius, pos[LSH_MAX_ROWS];
+	uint32_t *candidates;
+	uint64_t key, flip;
+	int64_t num_out;
+	int j, failed = 0;
+
+
+	*out = NULL;
+	if (mih->num_sketches == 0)
+		return 0;
+
+	candidates = (uint32_t*) malloc(sizeof(uint32_t)*size);
+	if (candidates == NULL)
+		return -1;
+
+	// Within radius of the query, some substring is within radius/substrings of the query substring
+	sub_radius = radius/mih->bands;
+
+	for (band=0; band<mih->bands && !failed; ++band){
+
+		key = lsh_band(mih, sketch, band);
+		len = (mih->m - band + mih->bands - 1)/mih->bands;
+
+		// Every value at distance weight from key, flipped positions pos[0] < ... < pos[weight-1]
+		for (weight=0; weight<=sub_radius && weight<=len && !failed; ++weight){
+			for (j=0; j<(int)weight; ++j)
+				pos[j] = j;
+			while (1){
+				flip = 0;
+				for (j=0; j<(int)weight; ++j)
+					flip |= (uint64_t)1 << pos[j];
+				if (lsh_collect(mih, band, key ^ flip, &candidates, &num_candidates, &size) != 0){
+					failed = 1;
+					break;
+				}
+				// Next combination
+				for (j=(int)weight-1; j>=0 && pos[j] == len-weight+j; --j);
+				if (j < 0)
+					break;
+				pos[j]++;
+				for (++j; j<(int)weight; ++j)
+					pos[j] = pos[j-1]+1;
+			}
+		}
+
+	}
+
+	num_out = failed ? -1 : lsh_verify(mih, sketch, candidates, num_candidates, 0, 0, radius, out);
+	free(candidates);
+
+	return num_out;
+
+}
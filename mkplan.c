@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "sparsehash.h"
+
+
+// Generate a plan file to be mapped by sparsehash_plan_map
+int main(int argc, char const *argv[]) {
+
+	sparsehash_plan_t *plan;
+	sparsehash_variant_t variant = SPARSEHASH_FAST;
+	sparsehash_hash_t hash = SPARSEHASH_HASH_MURMUR3;
+	uint32_t m, seed;
+	double gamma;
+
+
+	if (argc < 5){
+		fprintf(stderr, "usage: %s plan_file m seed gamma [exact|medium|fast] [murmur3|wyhash]\n", argv[0]);
+		fprintf(stderr, "       gamma >= 1 is taken as the expected sparsity and converted with get_gamma\n");
+		return 1;
+	}
+
+	m = strtoul(argv[2], NULL, 10);
+	seed = strtoul(argv[3], NULL, 10);
+	gamma = atof(argv[4]);
+	if (gamma >= 1)
+		gamma = get_gamma((uint32_t)gamma);
+
+	if (argc > 5){
+		if (strcmp(argv[5], "exact") == 0)
+			variant = SPARSEHASH_EXACT;
+		else if (strcmp(argv[5], "medium") == 0)
+			variant = SPARSEHASH_MEDIUM;
+		else if (strcmp(argv[5], "fast") != 0){
+			fprintf(stderr, "unknown variant %s\n", argv[5]);
+			return 1;
+		}
+	}
+
+	if (argc > 6){
+		if (strcmp(argv[6], "wyhash") == 0)
+			hash = SPARSEHASH_HASH_WYHASH;
+		else if (strcmp(argv[6], "murmur3") != 0){
+			fprintf(stderr, "unknown hash %s\n", argv[6]);
+			return 1;
+		}
+	}
+
+	if (m == 0 || gamma <= 0){
+		fprintf(stderr, "invalid m or gamma\n");
+		return 1;
+	}
+
+	plan = sparsehash_plan_create(seed, gamma, m, variant);
+	if (plan == NULL){
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	sparsehash_plan_set_hash(plan, hash);
+
+	// Store the Eytzinger layout, mapped plans then use it with no setup
+	if (variant == SPARSEHASH_FAST && sparsehash_plan_set_lookup(plan, SPARSEHASH_LOOKUP_EYTZINGER) != 0){
+		fprintf(stderr, "out of memory\n");
+		sparsehash_plan_destroy(plan);
+		return 1;
+	}
+
+	if (sparsehash_plan_save(plan, argv[1]) != 0){
+		fprintf(stderr, "cannot write %s\n", argv[1]);
+		sparsehash_plan_destroy(plan);
+		return 1;
+	}
+
+	sparsehash_plan_destroy(plan);
+
+	return 0;
+
+}
@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sparsehash.h"
+
+
+#define PLAN_MAGIC "SPHPLAN"
+#define PLAN_VERSION 3
+#define PLAN_ENDIAN 0x01020304
+#define PLAN_ALIGN 64
+
+
+// Header of a plan file, tables follow at PLAN_ALIGN-aligned offsets (0 if absent)
+typedef struct{
+
+	char magic[8];
+	uint32_t version;
+	uint32_t endian;
+	uint32_t variant;
+	uint32_t seed;
+	double gamma;
+	uint32_t m;
+	uint32_t hash_seed;
+	uint32_t hash;
+	uint32_t reserved;
+	uint64_t tau;
+	uint64_t seeds_offset;
+	uint64_t bot_offset;
+	uint64_t top_offset;
+	uint64_t eytz_offset;
+	uint64_t eytz_idx_offset;
+	uint64_t file_size;
+
+} plan_header_t;
+
+
+static inline uint64_t align_up(uint64_t x){
+	return (x + PLAN_ALIGN-1) & ~((uint64_t)PLAN_ALIGN-1);
+}
+
+
+// Write len bytes of buf at offset, zero-padding from the current position. buf may be NULL if len is 0
+static int write_at(FILE *fp, uint64_t *pos, uint64_t offset, const void *buf, size_t len){
+
+	static const char zeros[PLAN_ALIGN] = {0};
+
+
+	if (offset > *pos && fwrite(zeros, 1, offset-*pos, fp) != offset-*pos)
+		return -1;
+	if (len > 0 && fwrite(buf, 1, len, fp) != len)
+		return -1;
+	*pos = offset+len;
+
+	return 0;
+
+}
+
+
+int sparsehash_plan_save(const sparsehash_plan_t *plan, const char *path){
+
+	plan_header_t header;
+	uint64_t pos, table_len;
+	FILE *fp;
+	int err = 0;
+
+
+	memset(&header, 0, sizeof(plan_header_t));
+	memcpy(header.magic, PLAN_MAGIC, sizeof(PLAN_MAGIC));
+	header.version = PLAN_VERSION;
+	header.endian = PLAN_ENDIAN;
+	header.variant = plan->variant;
+	header.seed = plan->seed;
+	header.gamma = plan->gamma;
+	header.m = plan->m;
+	header.hash_seed = plan->hash_seed;
+	header.hash = plan->hash;
+	header.tau = plan->tau;
+
+	pos = align_up(sizeof(plan_header_t));
+	if (plan->variant == SPARSEHASH_EXACT){
+		table_len = sizeof(uint32_t)*(uint64_t)plan->m;
+		header.seeds_offset = pos;
+		pos = align_up(pos+table_len);
+	}
+	else{
+		table_len = sizeof(uint64_t)*(uint64_t)plan->m;
+		header.bot_offset = pos;
+		header.top_offset = align_up(pos+table_len);
+		pos = align_up(header.top_offset+table_len);
+		// Eytzinger layout, if built, so that mapped plans get the fastest lookup
+		if (plan->eytz_bot != NULL){
+			header.eytz_offset = pos;
+			header.eytz_idx_offset = align_up(pos+sizeof(uint64_t)*((uint64_t)plan->m+1));
+			pos = align_up(header.eytz_idx_offset+sizeof(uint32_t)*((uint64_t)plan->m+1));
+		}
+	}
+	header.file_size = pos;
+
+	fp = fopen(path, "wb");
+	if (fp == NULL)
+		return -1;
+
+	pos = 0;
+	err |= write_at(fp, &pos, 0, &header, sizeof(plan_header_t));
+	if (plan->variant == SPARSEHASH_EXACT)
+		err |= write_at(fp, &pos, header.seeds_offset, plan->seeds, table_len);
+	else{
+		err |= write_at(fp, &pos, header.bot_offset, plan->bot, table_len);
+		err |= write_at(fp, &pos, header.top_offset, plan->top, table_len);
+		if (plan->eytz_bot != NULL){
+			err |= write_at(fp, &pos, header.eytz_offset, plan->eytz_bot, sizeof(uint64_t)*((uint64_t)plan->m+1));
+			err |= write_at(fp, &pos, header.eytz_idx_offset, plan->eytz_idx, sizeof(uint32_t)*((uint64_t)plan->m+1));
+		}
+	}
+	if (err == 0)
+		err |= write_at(fp, &pos, header.file_size, NULL, 0);
+
+	if (fclose(fp) != 0)
+		err = -1;
+
+	return err;
+
+}
+
+
+// Check that a table of len bytes at offset lies in the file
+static int table_ok(const plan_header_t *header, uint64_t offset, uint64_t len){
+	return (offset >= sizeof(plan_header_t)) && (offset % PLAN_ALIGN == 0) && (offset <= header->file_size) && (len <= header->file_size-offset);
+}
+
+
+// Check that the m+1 positions of the Eytzinger layout index bot and top, the first one is m
+static int eytz_idx_ok(const uint32_t *idx, uint32_t m){
+
+	uint32_t i;
+
+
+	for (i=0; i<=m; ++i)
+		if (idx[i] > m)
+			return 0;
+
+	return 1;
+
+}
+
+
+sparsehash_plan_t* sparsehash_plan_map(const char *path){
+
+	int fd;
+	struct stat st;
+	void *map;
+	const plan_header_t *header;
+	sparsehash_plan_t *plan;
+	int ok;
+
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(plan_header_t)){
+		close(fd);
+		return NULL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	// Validate before handing out pointers into the mapping
+	header = (const plan_header_t*)map;
+	ok = (memcmp(header->magic, PLAN_MAGIC, sizeof(PLAN_MAGIC)) == 0) && (header->version == PLAN_VERSION) && (header->endian == PLAN_ENDIAN);
+	ok = ok && (header->file_size == (uint64_t)st.st_size) && (header->m > 0);
+	ok = ok && (header->hash == SPARSEHASH_HASH_MURMUR3 || header->hash == SPARSEHASH_HASH_WYHASH);
+	if (ok && header->variant == SPARSEHASH_EXACT)
+		ok = table_ok(header, header->seeds_offset, sizeof(uint32_t)*(uint64_t)header->m);
+	else
+		ok = ok && (header->variant == SPARSEHASH_MEDIUM || header->variant == SPARSEHASH_FAST)
+			&& table_ok(header, header->bot_offset, sizeof(uint64_t)*(uint64_t)header->m)
+			&& table_ok(header, header->top_offset, sizeof(uint64_t)*(uint64_t)header->m);
+	if (ok && header->eytz_offset != 0)
+		ok = table_ok(header, header->eytz_offset, sizeof(uint64_t)*((uint64_t)header->m+1))
+			&& table_ok(header, header->eytz_idx_offset, sizeof(uint32_t)*((uint64_t)header->m+1))
+			&& eytz_idx_ok((const uint32_t*)((const char*)map + header->eytz_idx_offset), header->m);
+
+	plan = ok ? (sparsehash_plan_t*) calloc(1, sizeof(sparsehash_plan_t)) : NULL;
+	if (plan == NULL){
+		munmap(map, st.st_size);
+		return NULL;
+	}
+
+	plan->variant = (sparsehash_variant_t)header->variant;
+	plan->seed = header->seed;
+	plan->gamma = header->gamma;
+	plan->m = header->m;
+	plan->mbytes = header->m/8;
+	if (header->m%8!=0)
+		plan->mbytes++;
+	plan->tau = header->tau;
+	plan->hash_seed = header->hash_seed;
+	plan->hash = (sparsehash_hash_t)header->hash;
+	plan->map = map;
+	plan->map_size = st.st_size;
+
+	if (plan->variant == SPARSEHASH_EXACT)
+		plan->seeds = (uint32_t*)((char*)map + header->seeds_offset);
+	else{
+		plan->bot = (uint64_t*)((char*)map + header->bot_offset);
+		plan->top = (uint64_t*)((char*)map + header->top_offset);
+		plan->lookup = SPARSEHASH_LOOKUP_BINARY;
+		if (header->eytz_offset != 0){
+			plan->eytz_bot = (uint64_t*)((char*)map + header->eytz_offset);
+			plan->eytz_idx = (uint32_t*)((char*)map + header->eytz_idx_offset);
+			plan->lookup = SPARSEHASH_LOOKUP_EYTZINGER;
+		}
+	}
+
+	return plan;
+
+}
@@ -0,0 +1,140 @@
+#include "sparsehash.h"
+#include "kernels.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+// Keys read and sketched at a time by a worker, bounds its memory to this many keys and hashes
+#define SHARD_CHUNK 1048576
+
+
+// Read len bytes at offset, retrying short reads. 0 if successful, -1 otherwise
+static int shard_read(int fd, char *buf, size_t len, off_t offset){
+
+	ssize_t got;
+
+
+	while (len > 0){
+		got = pread(fd, buf, len, offset);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got <= 0)
+			return -1;
+		buf += got;
+		len -= got;
+		offset += got;
+	}
+
+	return 0;
+
+}
+
+
+// Sketch keys first to last-1 of the file into out (already zeroed), one chunk at a time
+static int shard_sketch(const sparsehash_plan_t *plan, int fd, uint32_t key_size, uint64_t first, uint64_t last, char *out){
+
+	char *keys;
+	uint64_t *hashes = NULL, at;
+	uint32_t n;
+	int ret = 0;
+
+
+	keys = (char*) malloc((size_t)SHARD_CHUNK*key_size);
+	if (plan->variant != SPARSEHASH_EXACT)
+		hashes = (uint64_t*) malloc(sizeof(uint64_t)*SHARD_CHUNK);
+	if (keys == NULL || (plan->variant != SPARSEHASH_EXACT && hashes == NULL)){
+		free(keys);
+		free(hashes);
+		return -1;
+	}
+
+	for (at=first; at<last && ret==0; at+=n){
+		n = (last-at > SHARD_CHUNK) ? SHARD_CHUNK : (uint32_t)(last-at);
+		ret = shard_read(fd, keys, (size_t)n*key_size, (off_t)(at*key_size));
+		if (ret == 0)
+			sparsehash_kernel(plan, keys, n, key_size, NULL, hashes, out);
+	}
+
+	free(keys);
+	free(hashes);
+
+	return ret;
+
+}
+
+
+int sparsehash_sketch_file_sharded(const sparsehash_plan_t *plan, const char *path, uint32_t key_size, uint32_t num_workers, char *out){
+
+	int fd, status, ret = 0;
+	struct stat st;
+	uint64_t num_keys;
+	uint32_t w, started;
+	pid_t *pids;
+	char *partial;
+
+
+	if (key_size == 0 || num_workers == 0)
+		return -1;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) != 0 || st.st_size % key_size != 0){
+		close(fd);
+		return -1;
+	}
+	num_keys = st.st_size/key_size;
+	if (num_workers > num_keys)
+		num_workers = (num_keys > 0) ? num_keys : 1;
+
+	// Partial sketches written by the workers, shared with the parent
+	partial = (char*) mmap(NULL, (size_t)num_workers*plan->mbytes, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	pids = (pid_t*) malloc(sizeof(pid_t)*num_workers);
+	if (partial == MAP_FAILED || pids == NULL){
+		if (partial != MAP_FAILED)
+			munmap(partial, (size_t)num_workers*plan->mbytes);
+		free(pids);
+		close(fd);
+		return -1;
+	}
+
+	// Workers inherit the plan, its pages are only read so they stay shared
+	for (started=0; started<num_workers; ++started){
+		pids[started] = fork();
+		if (pids[started] < 0){
+			ret = -1;
+			break;
+		}
+		if (pids[started] == 0){
+#ifdef _OPENMP
+			// One thread per worker, the parallelism is across processes
+			omp_set_num_threads(1);
+#endif
+			_exit( shard_sketch(plan, fd, key_size, num_keys*started/num_workers, num_keys*(started+1)/num_workers,
+							   partial + (size_t)started*plan->mbytes) != 0 );
+		}
+	}
+
+	for (w=0; w<started; ++w){
+		if (waitpid(pids[w], &status, 0) != pids[w] || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			ret = -1;
+	}
+
+	if (ret == 0)
+		sparsehash_merge(out, partial, num_workers, plan->m);
+
+	munmap(partial, (size_t)num_workers*plan->mbytes);
+	free(pids);
+	close(fd);
+
+	return ret;
+
+}
@@ -0,0 +1,349 @@
+#include "simd.h"
+#include <string.h>
+#if SIMD_X86
+#include <immintrin.h>
+#endif
+
+
+// No early exit, so that the loop vectorizes; callers pass L1-sized tiles
+SIMD_CLONES
+int simd_window_any(const uint64_t *hashes, const uint32_t n, const uint64_t bot, const uint64_t width){
+
+	uint32_t h;
+	uint64_t any = 0;
+
+
+	for (h=0; h<n; ++h)
+		any |= (hashes[h] - bot < width);
+
+	return any != 0;
+
+}
+
+
+// Popcounts of sketches: AVX-512 VPOPCNTDQ, AVX2 nibble lookup table, or 64-bit words. Kernels are specialized
+// on the bitwise operation applied to the two sketches and leave the bytes after the last full vector to the word loop
+
+struct op_xor{
+
+	static inline uint64_t word(uint64_t a, uint64_t b){ return a ^ b; }
+#if SIMD_X86
+	SIMD_TARGET("avx512f") static inline __m512i v512(__m512i a, __m512i b){ return _mm512_xor_si512(a, b); }
+	SIMD_TARGET("avx2") static inline __m256i v256(__m256i a, __m256i b){ return _mm256_xor_si256(a, b); }
+#endif
+
+};
+
+struct op_or{
+
+	static inline uint64_t word(uint64_t a, uint64_t b){ return a | b; }
+#if SIMD_X86
+	SIMD_TARGET("avx512f") static inline __m512i v512(__m512i a, __m512i b){ return _mm512_or_si512(a, b); }
+	SIMD_TARGET("avx2") static inline __m256i v256(__m256i a, __m256i b){ return _mm256_or_si256(a, b); }
+#endif
+
+};
+
+
+static inline uint64_t load_word(const uint8_t *p){
+
+	uint64_t w;
+	memcpy(&w, p, sizeof(uint64_t));
+	return w;
+
+}
+
+
+// Scalar words, inlined into the kernels so that the tails use their popcnt instruction
+template<class Op>
+static inline __attribute__((always_inline)) uint64_t popcount_words(const uint8_t *a, const uint8_t *b, size_t n){
+
+	size_t i;
+	uint64_t count = 0;
+
+
+	for (i=0; i+8<=n; i+=8)
+		count += __builtin_popcountll( Op::word(load_word(a+i), load_word(b+i)) );
+	for (; i<n; ++i)
+		count += __builtin_popcountll( Op::word(a[i], b[i]) );
+
+	return count;
+
+}
+
+
+static inline __attribute__((always_inline)) void popcount_or_words(const uint8_t *a, const uint8_t *b, size_t n, uint64_t *counts){
+
+	size_t i;
+	uint64_t wa, wb;
+
+
+	for (i=0; i+8<=n; i+=8){
+		wa = load_word(a+i);
+		wb = load_word(b+i);
+		counts[0] += __builtin_popcountll(wa);
+		counts[1] += __builtin_popcountll(wb);
+		counts[2] += __builtin_popcountll(wa | wb);
+	}
+	for (; i<n; ++i){
+		counts[0] += __builtin_popcount(a[i]);
+		counts[1] += __builtin_popcount(b[i]);
+		counts[2] += __builtin_popcount( (uint8_t)(a[i] | b[i]) );
+	}
+
+}
+
+
+#if SIMD_X86
+
+// Kernels also target popcnt, present on every CPU with AVX2, for the words of the tail
+template<class Op>
+SIMD_TARGET("avx512f,avx512vpopcntdq,popcnt")
+static uint64_t popcount_avx512(const uint8_t *a, const uint8_t *b, size_t n){
+
+	size_t i;
+	__m512i acc = _mm512_setzero_si512();
+
+
+	for (i=0; i+64<=n; i+=64)
+		acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64( Op::v512(_mm512_loadu_si512(a+i), _mm512_loadu_si512(b+i)) ));
+
+	return _mm512_reduce_add_epi64(acc) + popcount_words<Op>(a+i, b+i, n-i);
+
+}
+
+
+SIMD_TARGET("avx512f,avx512vpopcntdq,popcnt")
+static void popcount_or_avx512(const uint8_t *a, const uint8_t *b, size_t n, uint64_t *counts){
+
+	size_t i;
+	__m512i va, vb;
+	__m512i acc_a = _mm512_setzero_si512(), acc_b = _mm512_setzero_si512(), acc_ab = _mm512_setzero_si512();
+
+
+	for (i=0; i+64<=n; i+=64){
+		va = _mm512_loadu_si512(a+i);
+		vb = _mm512_loadu_si512(b+i);
+		acc_a = _mm512_add_epi64(acc_a, _mm512_popcnt_epi64(va));
+		acc_b = _mm512_add_epi64(acc_b, _mm512_popcnt_epi64(vb));
+		acc_ab = _mm512_add_epi64(acc_ab, _mm512_popcnt_epi64(_mm512_or_si512(va, vb)));
+	}
+
+	counts[0] += _mm512_reduce_add_epi64(acc_a);
+	counts[1] += _mm512_reduce_add_epi64(acc_b);
+	counts[2] += _mm512_reduce_add_epi64(acc_ab);
+	popcount_or_words(a+i, b+i, n-i, counts);
+
+}
+
+
+// Popcount of every byte of v, looked up one nibble at a time
+SIMD_TARGET("avx2")
+static inline __m256i popcount_bytes_avx2(__m256i v){
+
+	const __m256i lut = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4, 0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+	const __m256i low = _mm256_set1_epi8(0x0F);
+
+	return _mm256_add_epi8( _mm256_shuffle_epi8(lut, _mm256_and_si256(v, low)),
+							_mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)) );
+
+}
+
+
+// Sum of the bytes of v in four 64-bit lanes
+SIMD_TARGET("avx2")
+static inline __m256i sum_bytes_avx2(__m256i v){
+
+	return _mm256_sad_epu8(v, _mm256_setzero_si256());
+
+}
+
+
+SIMD_TARGET("avx2")
+static inline uint64_t reduce_avx2(__m256i v){
+
+	return (uint64_t)_mm256_extract_epi64(v,0) + (uint64_t)_mm256_extract_epi64(v,1) + (uint64_t)_mm256_extract_epi64(v,2) + (uint64_t)_mm256_extract_epi64(v,3);
+
+}
+
+
+template<class Op>
+SIMD_TARGET("avx2,popcnt")
+static uint64_t popcount_avx2(const uint8_t *a, const uint8_t *b, size_t n){
+
+	size_t i;
+	__m256i v, acc = _mm256_setzero_si256();
+
+
+	for (i=0; i+32<=n; i+=32){
+		v = Op::v256( _mm256_loadu_si256((const __m256i*)(a+i)), _mm256_loadu_si256((const __m256i*)(b+i)) );
+		acc = _mm256_add_epi64(acc, sum_bytes_avx2(popcount_bytes_avx2(v)));
+	}
+
+	return reduce_avx2(acc) + popcount_words<Op>(a+i, b+i, n-i);
+
+}
+
+
+SIMD_TARGET("avx2,popcnt")
+static void popcount_or_avx2(const uint8_t *a, const uint8_t *b, size_t n, uint64_t *counts){
+
+	size_t i;
+	__m256i va, vb;
+	__m256i acc_a = _mm256_setzero_si256(), acc_b = _mm256_setzero_si256(), acc_ab = _mm256_setzero_si256();
+
+
+	for (i=0; i+32<=n; i+=32){
+		va = _mm256_loadu_si256((const __m256i*)(a+i));
+		vb = _mm256_loadu_si256((const __m256i*)(b+i));
+		acc_a = _mm256_add_epi64(acc_a, sum_bytes_avx2(popcount_bytes_avx2(va)));
+		acc_b = _mm256_add_epi64(acc_b, sum_bytes_avx2(popcount_bytes_avx2(vb)));
+		acc_ab = _mm256_add_epi64(acc_ab, sum_bytes_avx2(popcount_bytes_avx2(_mm256_or_si256(va, vb))));
+	}
+
+	counts[0] += reduce_avx2(acc_a);
+	counts[1] += reduce_avx2(acc_b);
+	counts[2] += reduce_avx2(acc_ab);
+	popcount_or_words(a+i, b+i, n-i, counts);
+
+}
+
+
+template<class Op>
+SIMD_TARGET("popcnt")
+static uint64_t popcount_popcnt(const uint8_t *a, const uint8_t *b, size_t n){
+
+	return popcount_words<Op>(a, b, n);
+
+}
+
+
+SIMD_TARGET("popcnt")
+static void popcount_or_popcnt(const uint8_t *a, const uint8_t *b, size_t n, uint64_t *counts){
+
+	popcount_or_words(a, b, n, counts);
+
+}
+
+#endif
+
+
+typedef uint64_t (*popcount_kernel_t)(const uint8_t *a, const uint8_t *b, size_t n);
+
+template<class Op>
+static uint64_t popcount_portable(const uint8_t *a, const uint8_t *b, size_t n){
+
+	return popcount_words<Op>(a, b, n);
+
+}
+
+
+// Widest kernel of this CPU, resolved once by callers looping over blocks
+template<class Op>
+static inline popcount_kernel_t popcount_kernel(void){
+
+#if SIMD_X86
+	if (__builtin_cpu_supports("avx512vpopcntdq"))
+		return popcount_avx512<Op>;
+	if (__builtin_cpu_supports("avx2"))
+		return popcount_avx2<Op>;
+	if (__builtin_cpu_supports("popcnt"))
+		return popcount_popcnt<Op>;
+#endif
+
+	return popcount_portable<Op>;
+
+}
+
+
+template<class Op>
+static inline uint64_t popcount_dispatch(const uint8_t *a, const uint8_t *b, size_t n){
+
+	return popcount_kernel<Op>()(a, b, n);
+
+}
+
+
+uint64_t simd_popcount_xor(const uint8_t *a, const uint8_t *b, size_t n){
+
+	return popcount_dispatch<op_xor>(a, b, n);
+
+}
+
+
+uint64_t simd_popcount_xor_bounded(const uint8_t *a, const uint8_t *b, size_t n, uint64_t limit){
+
+	popcount_kernel_t kernel = popcount_kernel<op_xor>();
+	size_t i, len;
+	uint64_t count = 0;
+
+
+	for (i=0; i<n; i+=SIMD_BOUND_BLOCK){
+		len = (n-i < SIMD_BOUND_BLOCK) ? n-i : SIMD_BOUND_BLOCK;
+		count += kernel(a+i, b+i, len);
+		if (count > limit)
+			break;
+	}
+
+	return count;
+
+}
+
+
+uint64_t simd_popcount_union(const uint8_t *a, const uint8_t *b, size_t n){
+
+	return popcount_dispatch<op_or>(a, b, n);
+
+}
+
+
+void simd_popcount_or(const uint8_t *a, const uint8_t *b, size_t n, uint64_t *counts){
+
+	counts[0] = counts[1] = counts[2] = 0;
+
+#if SIMD_X86
+	if (__builtin_cpu_supports("avx512vpopcntdq")){
+		popcount_or_avx512(a, b, n, counts);
+		return;
+	}
+	if (__builtin_cpu_supports("avx2")){
+		popcount_or_avx2(a, b, n, counts);
+		return;
+	}
+	if (__builtin_cpu_supports("popcnt")){
+		popcount_or_popcnt(a, b, n, counts);
+		return;
+	}
+#endif
+
+	popcount_or_words(a, b, n, counts);
+
+}
+
+
+// Gathers from logtab vectorize, so the row needs no calls to log
+SIMD_CLONES
+void simd_jaccard_row(const uint32_t *nzz, const uint32_t n, const double lnz_i, const double *lnz, const double *logtab, const double log_m, double *out){
+
+	uint32_t h;
+	double lzz;
+
+
+	for (h=0; h<n; ++h){
+		lzz = logtab[nzz[h]];
+		out[h] = (lnz_i + lnz[h] - lzz - log_m) / (lzz - log_m);
+	}
+
+}
+
+
+SIMD_CLONES
+void simd_or(uint8_t *dst, const uint8_t *src, const size_t n){
+
+	size_t i;
+
+
+	for (i=0; i<n; ++i)
+		dst[i] |= src[i];
+
+}
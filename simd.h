@@ -0,0 +1,44 @@
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+// Kernels compiled for several instruction sets, the best one for the CPU is picked when the program is loaded
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SIMD_X86 1
+#define SIMD_CLONES __attribute__((target_clones("avx512f","avx2","sse4.2","default")))
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SIMD_X86 0
+#define SIMD_CLONES
+#define SIMD_TARGET(isa)
+#endif
+
+
+// Nonzero if some of the n hashes is in [bot, bot+width), one unsigned compare of hash-bot per hash
+int simd_window_any(const uint64_t *hashes, const uint32_t n, const uint64_t bot, const uint64_t width);
+
+// Hamming weight of a^b over n bytes
+uint64_t simd_popcount_xor(const uint8_t *a, const uint8_t *b, size_t n);
+
+// Hamming weight of a^b over n bytes, counted SIMD_BOUND_BLOCK bytes at a time and returned as soon as it is above limit
+#define SIMD_BOUND_BLOCK 256
+uint64_t simd_popcount_xor_bounded(const uint8_t *a, const uint8_t *b, size_t n, uint64_t limit);
+
+// Hamming weight of a|b over n bytes
+uint64_t simd_popcount_union(const uint8_t *a, const uint8_t *b, size_t n);
+
+// Hamming weights of a, b and a|b over n bytes in counts[0], counts[1] and counts[2]. Kernels of the
+// popcount functions are picked at run time from the features of the CPU
+void simd_popcount_or(const uint8_t *a, const uint8_t *b, size_t n, uint64_t *counts);
+
+// dst |= src over n bytes
+void simd_or(uint8_t *dst, const uint8_t *src, const size_t n);
+
+// Jaccard estimates of sketch i against n sketches from the zeros nzz of their ORs, as sparsehash_sim_J.
+// lnz_i and lnz are the logs of the zeros of the sketches, logtab[k] = log(k), log_m the log of the bits
+void simd_jaccard_row(const uint32_t *nzz, const uint32_t n, const double lnz_i, const double *lnz, const double *logtab, const double log_m, double *out);
+
+#endif // _SIMD_H_
@@ -0,0 +1,345 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sparsehash.h"
+#include "simd.h"
+
+
+#define DB_MAGIC "SPHSKDB"
+#define DB_VERSION 1
+#define DB_ENDIAN 0x01020304
+#define DB_ALIGN 64
+
+// Bytes hashed at a time by the checksum
+#define DB_CHECKSUM_CHUNK 1048576
+
+
+// Header of a sketch database, the sketch array and the tables follow at DB_ALIGN-aligned offsets (0 if absent)
+typedef struct{
+
+	char magic[8];
+	uint32_t version;
+	uint32_t endian;
+	uint32_t variant;
+	uint32_t seed;
+	double gamma;
+	uint32_t m;
+	uint32_t hash_seed;
+	uint32_t hash;
+	uint32_t stride;
+	uint64_t num_records;
+	uint64_t sketches_offset;
+	uint64_t ids_offset;
+	uint64_t popcounts_offset;
+	uint64_t file_size;
+	uint64_t data_checksum;		// sketch array and tables
+	uint64_t header_checksum;	// all the fields above
+
+} db_header_t;
+
+
+static inline uint64_t align_up(uint64_t x){
+	return (x + DB_ALIGN-1) & ~((uint64_t)DB_ALIGN-1);
+}
+
+
+// Chain the checksum h over len bytes
+static uint64_t db_checksum(uint64_t h, const void *buf, size_t len){
+
+	const char *p = (const char*)buf;
+	size_t chunk;
+
+
+	while (len > 0){
+		chunk = (len > DB_CHECKSUM_CHUNK) ? DB_CHECKSUM_CHUNK : len;
+		h = hashfn_fmix64(h ^ hashfn_wyhash_bytes(p, (int)chunk, (uint32_t)h));
+		p += chunk;
+		len -= chunk;
+	}
+
+	return h;
+
+}
+
+
+static uint64_t db_header_checksum(const db_header_t *header){
+
+	return db_checksum(0, header, offsetof(db_header_t, header_checksum));
+
+}
+
+
+// Ones in the m bits of sketch
+static uint32_t db_popcount(const char *sketch, uint32_t m){
+
+	uint32_t ones;
+
+
+	ones = simd_popcount_union((const uint8_t*)sketch, (const uint8_t*)sketch, m/8);
+	if (m%8 != 0)
+		ones += __builtin_popcount( (uint8_t)(sketch[m/8] & ~(0xFF >> (m%8))) );
+
+	return ones;
+
+}
+
+
+sparsehash_db_writer_t* sparsehash_db_create(const char *path, const sparsehash_plan_t *plan, uint32_t flags){
+
+	static const char zeros[DB_ALIGN] = {0};
+	sparsehash_db_writer_t *db;
+	db_header_t header;
+	size_t pad;
+
+
+	db = (sparsehash_db_writer_t*) calloc(1, sizeof(sparsehash_db_writer_t));
+	if (db == NULL)
+		return NULL;
+
+	db->fp = fopen(path, "wb");
+	db->record = (char*) calloc(1, align_up(plan->mbytes));
+	if (db->fp == NULL || db->record == NULL){
+		if (db->fp != NULL)
+			fclose(db->fp);
+		free(db->record);
+		free(db);
+		return NULL;
+	}
+
+	db->variant = plan->variant;
+	db->seed = plan->seed;
+	db->gamma = plan->gamma;
+	db->m = plan->m;
+	db->hash = plan->hash;
+	db->hash_seed = plan->hash_seed;
+	db->mbytes = plan->mbytes;
+	db->stride = align_up(plan->mbytes);
+	db->flags = flags;
+
+	// The header is written again by sparsehash_db_close, once the sizes are known. Its padding is written too,
+	// so that the file reaches the sketch array even with no records
+	memset(&header, 0, sizeof(db_header_t));
+	pad = align_up(sizeof(db_header_t)) - sizeof(db_header_t);
+	if (fwrite(&header, 1, sizeof(db_header_t), db->fp) != sizeof(db_header_t) || fwrite(zeros, 1, pad, db->fp) != pad)
+		db->err = -1;
+
+	return db;
+
+}
+
+
+int sparsehash_db_append(sparsehash_db_writer_t *db, const char *sketches, uint32_t num_sketches, const uint64_t *ids){
+
+	uint32_t s;
+	void *p;
+
+
+	if (db->err != 0)
+		return -1;
+
+	if ((db->flags & SPARSEHASH_DB_IDS) || (db->flags & SPARSEHASH_DB_POPCOUNTS)){
+		if (db->num_records + num_sketches > db->capacity){
+			db->capacity = (db->capacity > 0) ? db->capacity : 1024;
+			while (db->capacity < db->num_records + num_sketches)
+				db->capacity *= 2;
+			if ( (p = realloc(db->ids, sizeof(uint64_t)*db->capacity)) == NULL )
+				return db->err = -1;
+			db->ids = (uint64_t*)p;
+			if ( (p = realloc(db->popcounts, sizeof(uint32_t)*db->capacity)) == NULL )
+				return db->err = -1;
+			db->popcounts = (uint32_t*)p;
+		}
+	}
+
+	for (s=0; s<num_sketches; ++s){
+
+		// Padding bytes of the record stay zero
+		memcpy(db->record, sketches + (size_t)s*db->mbytes, db->mbytes);
+		if (fwrite(db->record, 1, db->stride, db->fp) != db->stride)
+			return db->err = -1;
+		db->data_checksum = db_checksum(db->data_checksum, db->record, db->stride);
+
+		if (db->flags & SPARSEHASH_DB_IDS)
+			db->ids[db->num_records] = (ids != NULL) ? ids[s] : db->num_records;
+		if (db->flags & SPARSEHASH_DB_POPCOUNTS)
+			db->popcounts[db->num_records] = db_popcount(db->record, db->m);
+		db->num_records++;
+
+	}
+
+	return 0;
+
+}
+
+
+int sparsehash_db_close(sparsehash_db_writer_t *db){
+
+	static const char zeros[DB_ALIGN] = {0};
+	db_header_t header;
+	uint64_t pos, len;
+	int err = db->err;
+
+
+	memset(&header, 0, sizeof(db_header_t));
+	memcpy(header.magic, DB_MAGIC, sizeof(DB_MAGIC));
+	header.version = DB_VERSION;
+	header.endian = DB_ENDIAN;
+	header.variant = db->variant;
+	header.seed = db->seed;
+	header.gamma = db->gamma;
+	header.m = db->m;
+	header.hash_seed = db->hash_seed;
+	header.hash = db->hash;
+	header.stride = db->stride;
+	header.num_records = db->num_records;
+	header.sketches_offset = align_up(sizeof(db_header_t));
+
+	// Tables after the sketch array, which ends aligned since the stride is
+	pos = header.sketches_offset + db->num_records*db->stride;
+	if (err == 0 && (db->flags & SPARSEHASH_DB_IDS)){
+		header.ids_offset = pos;
+		len = sizeof(uint64_t)*db->num_records;
+		if (db->num_records > 0 && fwrite(db->ids, 1, len, db->fp) != len)
+			err = -1;
+		db->data_checksum = db_checksum(db->data_checksum, db->ids, len);
+		pos += len;
+	}
+	if (err == 0 && (db->flags & SPARSEHASH_DB_POPCOUNTS)){
+		len = align_up(pos) - pos;
+		if (fwrite(zeros, 1, len, db->fp) != len)
+			err = -1;
+		pos += len;
+		header.popcounts_offset = pos;
+		len = sizeof(uint32_t)*db->num_records;
+		if (db->num_records > 0 && fwrite(db->popcounts, 1, len, db->fp) != len)
+			err = -1;
+		db->data_checksum = db_checksum(db->data_checksum, db->popcounts, len);
+		pos += len;
+	}
+
+	header.file_size = pos;
+	header.data_checksum = db->data_checksum;
+	header.header_checksum = db_header_checksum(&header);
+
+	if (err == 0 && (fseek(db->fp, 0, SEEK_SET) != 0 || fwrite(&header, 1, sizeof(db_header_t), db->fp) != sizeof(db_header_t)))
+		err = -1;
+	if (fclose(db->fp) != 0)
+		err = -1;
+
+	free(db->record);
+	free(db->ids);
+	free(db->popcounts);
+	free(db);
+
+	return err;
+
+}
+
+
+// Check that a table of len bytes at offset lies in the file
+static int table_ok(const db_header_t *header, uint64_t offset, uint64_t len){
+	return (offset >= sizeof(db_header_t)) && (offset % DB_ALIGN == 0) && (offset <= header->file_size) && (len <= header->file_size-offset);
+}
+
+
+sparsehash_db_t* sparsehash_db_map(const char *path){
+
+	int fd;
+	struct stat st;
+	void *map;
+	const db_header_t *header;
+	sparsehash_db_t *db;
+	int ok;
+
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(db_header_t)){
+		close(fd);
+		return NULL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	// Only the header is checked here, so that opening takes no time at any size. sparsehash_db_verify checks the data
+	header = (const db_header_t*)map;
+	ok = (memcmp(header->magic, DB_MAGIC, sizeof(DB_MAGIC)) == 0) && (header->version == DB_VERSION) && (header->endian == DB_ENDIAN);
+	ok = ok && (header->header_checksum == db_header_checksum(header));
+	ok = ok && (header->file_size == (uint64_t)st.st_size) && (header->m > 0);
+	ok = ok && (header->stride >= (header->m+7)/8) && (header->stride % DB_ALIGN == 0) && (header->sketches_offset % DB_ALIGN == 0);
+	ok = ok && (header->num_records <= header->file_size/header->stride);
+	ok = ok && table_ok(header, header->sketches_offset, header->num_records*header->stride);
+	if (ok && header->ids_offset != 0)
+		ok = table_ok(header, header->ids_offset, sizeof(uint64_t)*header->num_records);
+	if (ok && header->popcounts_offset != 0)
+		ok = table_ok(header, header->popcounts_offset, sizeof(uint32_t)*header->num_records);
+
+	db = ok ? (sparsehash_db_t*) calloc(1, sizeof(sparsehash_db_t)) : NULL;
+	if (db == NULL){
+		munmap(map, st.st_size);
+		return NULL;
+	}
+
+	db->variant = (sparsehash_variant_t)header->variant;
+	db->seed = header->seed;
+	db->gamma = header->gamma;
+	db->m = header->m;
+	db->hash = (sparsehash_hash_t)header->hash;
+	db->hash_seed = header->hash_seed;
+	db->stride = header->stride;
+	db->num_records = header->num_records;
+	db->sketches = (const char*)map + header->sketches_offset;
+	db->ids = (header->ids_offset != 0) ? (const uint64_t*)((const char*)map + header->ids_offset) : NULL;
+	db->popcounts = (header->popcounts_offset != 0) ? (const uint32_t*)((const char*)map + header->popcounts_offset) : NULL;
+	db->map = map;
+	db->map_size = st.st_size;
+
+	return db;
+
+}
+
+
+int sparsehash_db_verify(const sparsehash_db_t *db){
+
+	const db_header_t *header = (const db_header_t*)db->map;
+	uint64_t h = 0, r;
+
+
+	for (r=0; r<db->num_records; ++r)
+		h = db_checksum(h, db->sketches + r*db->stride, db->stride);
+	if (db->ids != NULL)
+		h = db_checksum(h, db->ids, sizeof(uint64_t)*db->num_records);
+	if (db->popcounts != NULL)
+		h = db_checksum(h, db->popcounts, sizeof(uint32_t)*db->num_records);
+
+	return (h == header->data_checksum) ? 0 : -1;
+
+}
+
+
+int sparsehash_db_compatible(const sparsehash_db_t *db, const sparsehash_plan_t *plan){
+
+	// Medium and fast only differ in the lookup, so their sketches are the same
+	return (db->variant == SPARSEHASH_EXACT) == (plan->variant == SPARSEHASH_EXACT) && db->seed == plan->seed && db->gamma == plan->gamma && db->m == plan->m
+		&& db->hash == plan->hash && db->hash_seed == plan->hash_seed;
+
+}
+
+
+void sparsehash_db_unmap(sparsehash_db_t *db){
+
+	if (db == NULL)
+		return;
+
+	munmap(db->map, db->map_size);
+	free(db);
+
+}
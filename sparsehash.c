@@ -1,10 +1,55 @@
-
 #include "sparsehash.h"
 #include "utils.h"
+#include "kernels.h"
+#include "simd.h"
+#include "stats.h"
+#include <sys/mman.h>
+
+
+// Sets with more elements than this are split in chunks by sparsehash_sketch_batch
+#define BATCH_CHUNK 65536
+
+// Largest number of bits of the bucket index, 2^30 buckets take 4 GiB
+#define BUCKET_MAX_BITS 30
+
+// Bytes of the merged sketch ORed by all the inputs before moving on, L1-sized
+#define MERGE_TILE 16384
+
+// Sketches ahead and bytes of each prefetched by sparsehash_dist_H_bounded_many, the first block of the bounded count
+#define BOUNDED_PREFETCH 8
+#define BOUNDED_PREFETCH_BYTES 256
+
+// Key size of the kernels for element_size, strings are 0
+#define KEY_SIZE(element_size) (((element_size)==1) ? 0 : (element_size))
+
+// Streams of the counter-based generator
+#define PLAN_STREAM_INTERVALS 0
+#define PLAN_STREAM_HASH 1
+
+
+// Unit of work of sparsehash_sketch_batch, a whole set or a chunk of a large one
+typedef struct{
+
+	uint64_t begin;
+	uint64_t end;
+	uint32_t set;
+	uint32_t split;
+
+} batch_unit_t;
 
 
-static inline uint64_t rand_64 (){
-	return (((uint64_t) rand() <<  0) & 0x00000000FFFFFFFFull) | (((uint64_t) rand() << 32) & 0xFFFFFFFF00000000ull);
+// Finalizer of SplitMix64
+static inline uint64_t mix_64 (uint64_t z){
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+
+}
+
+// Counter-based generator: value number ctr of the given stream, only depends on its arguments
+static inline uint64_t plan_rand (uint32_t seed, uint32_t stream, uint64_t ctr){
+	return mix_64( mix_64( ((uint64_t)seed << 32) | stream ) + ctr*0x9E3779B97F4A7C15ull );
 }
 
 // Comparison function for quicksort
@@ -22,587 +67,431 @@ int cmpfunc (const void * a, const void * b){
 
 }
 
+// Comparison function for quicksort, larger units first
+static int cmpunit (const void * a, const void * b){
 
-// Data is array of strings
-static void sparsehash_compute_char(char **data, uint32_t num_elements, uint16_t *str_len, double gamma, uint32_t m, char *out){
-
-	uint32_t h, i, ibyte;
-	uint32_t *seeds;
-	uint64_t hash[2];
-	double tau;
-
+	uint64_t len_a = ((batch_unit_t*)a)->end - ((batch_unit_t*)a)->begin;
+	uint64_t len_b = ((batch_unit_t*)b)->end - ((batch_unit_t*)b)->begin;
 
-	seeds = (uint32_t*) malloc(sizeof(uint32_t)*m);
-	for (i = 0; i < m; i++)	{
-		seeds[i] = rand();
+	if (len_a < len_b)
+		return 1;
+	else{
+		if (len_a > len_b)
+			return -1;
+		else
+			return 0;
 	}
-	
-	tau = gamma*UINT64_MAX;
-
-	#pragma omp parallel for private(i,ibyte,h,hash) shared(data, str_len)
-	for (i = 0; i < m; i++) { 
-
-		for ( h=0; h<num_elements; h++) {
 
-			MurmurHash3_x64_128( data[h], str_len[h], seeds[i], hash );
-			if (hash[0] < tau) {
-				ibyte = i/8;
-				out[ibyte] =  out[ibyte] | ( (0x80) >> (i%8) );
-				break;
-			}
+}
 
-		}
 
-	}
+// Tables of a mapped plan live in the mapping, except the ones built after mapping it
+static void sparsehash_plan_free(const sparsehash_plan_t *plan, void *ptr){
 
-	free(seeds);
+	if (plan->map == NULL || (char*)ptr < (char*)plan->map || (char*)ptr >= (char*)plan->map + plan->map_size)
+		free(ptr);
 
 }
 
 
-static void sparsehash_compute_char_medium(char **data, uint32_t num_elements, uint16_t *str_len, double gamma, uint32_t m, char *out){
-
-	uint32_t h, i, ibyte;
-	uint64_t tau;
-	uint64_t *bot, *top;
-	uint64_t hash[2];
-	uint64_t *hashes;
+sparsehash_plan_t* sparsehash_plan_create(uint32_t seed, double gamma, uint32_t m, sparsehash_variant_t variant){
 
+	uint32_t i;
+	sparsehash_plan_t *plan;
 
-	tau = (uint64_t)(gamma*UINT64_MAX);
 
-	bot = (uint64_t*) malloc(sizeof(uint64_t)*m);
-	top = (uint64_t*) malloc(sizeof(uint64_t)*m);
-	for (i = 0; i < m; i++)	{
-		bot[i] = rand_64();
-		if (bot[i]>UINT64_MAX-tau)
-			top[i] = tau-(UINT64_MAX-bot[i]);
-		else
-			top[i] = bot[i] + tau;
-	}
-	
-	hashes = (uint64_t*)malloc(sizeof(uint64_t)*num_elements);
+	plan = (sparsehash_plan_t*) calloc(1, sizeof(sparsehash_plan_t));
+	if (plan == NULL)
+		return NULL;
 
-	#pragma omp parallel for private(h,hash)
-	for ( h=0; h<num_elements; ++h) {
-		MurmurHash3_x64_128 ( data[h], str_len[h], bot[0], hash );
-		hashes[h] = hash[0];
-	}
-
-	#pragma omp parallel for private(i,ibyte,h)
-	for (i = 0; i < m; ++i) { 
-
-		for ( h=0; h<num_elements; ++h) {
+	plan->variant = variant;
+	plan->seed = seed;
+	plan->gamma = gamma;
+	plan->m = m;
+	plan->mbytes = m/8;
+	if (m%8!=0)
+		plan->mbytes++;
+	plan->tau = (uint64_t)(gamma*UINT64_MAX);
 
-			if ((hashes[h] < top[i]) && (hashes[h] >= bot[i])) {
-				ibyte = i/8;
-				out[ibyte] =  out[ibyte] | ( (0x80) >> (i%8) );
-				break;
-			}
+	STATS_START(t_intervals);
 
+	if (variant == SPARSEHASH_EXACT){
+		plan->seeds = (uint32_t*) malloc(sizeof(uint32_t)*m);
+		if (plan->seeds == NULL){
+			sparsehash_plan_destroy(plan);
+			return NULL;
 		}
-
+		#pragma omp parallel for
+		for (i = 0; i < m; i++)	{
+			plan->seeds[i] = (uint32_t)plan_rand(seed, PLAN_STREAM_INTERVALS, i);
+		}
+		STATS_STOP(SPARSEHASH_PHASE_PLAN_INTERVALS, t_intervals);
+		return plan;
 	}
 
-	free(bot);
-	free(top);
-	free(hashes);
-
-}
-
-
-static void sparsehash_compute_char_fast(char **data, uint32_t num_elements, uint16_t *str_len, double gamma, uint32_t m, char *out){
-
-	uint32_t h, i, ibyte, meas;
-	uint64_t tau;
-	uint64_t *bot;
-	uint64_t hash[2];
-	uint64_t *hashes;
-	bst_t *bot_tree, *head, *ptr;
-
-
-	tau = (uint64_t)(gamma*UINT64_MAX);
+	plan->hash_seed = (uint32_t)plan_rand(seed, PLAN_STREAM_HASH, 0);
 
 	// Generate bottoms of intervals
-	bot = (uint64_t*) malloc(sizeof(uint64_t)*m);
+	plan->bot = (uint64_t*) malloc(sizeof(uint64_t)*m);
+	plan->top = (uint64_t*) malloc(sizeof(uint64_t)*m);
+	if (plan->bot == NULL || plan->top == NULL){
+		sparsehash_plan_destroy(plan);
+		return NULL;
+	}
+	#pragma omp parallel for
 	for (i = 0; i < m; i++)	{
-		bot[i] = rand_64();
+		plan->bot[i] = plan_rand(seed, PLAN_STREAM_INTERVALS, i);
 	}
+	STATS_STOP(SPARSEHASH_PHASE_PLAN_INTERVALS, t_intervals);
 
-	// Compute hashes
-	hashes = (uint64_t*)malloc(sizeof(uint64_t)*num_elements);
-	//#pragma omp parallel for private(h,hash)
-	for ( h=0; h<num_elements; ++h) {
-		MurmurHash3_x64_128 ( data[h], str_len[h], bot[0], hash );
-		hashes[h] = hash[0];
-	}
+	// Sort bottoms, measurement i is the interval with the i-th smallest bottom
+	STATS_START(t_sort);
+	qsort(plan->bot, m, sizeof(uint64_t), cmpfunc);
+	STATS_STOP(SPARSEHASH_PHASE_PLAN_SORT, t_sort);
 
-	// Sort bottoms
-	qsort(bot, m, sizeof(uint64_t), cmpfunc);
-
-	// Build a binary search tree for the extremes
-	bot_tree = (bst_t*) malloc(sizeof(bst_t)*m);
-	head = buildTree(bot, m, tau, bot_tree);
-
-	// Compute measurements by traversing the tree
-	//#pragma omp parallel for private(h,hash,ptr,ibyte,meas)
-	for ( h=0; h<num_elements; ++h){
-
-		ptr = head;
-		while(ptr!=NULL){
-			if(hashes[h] < ptr->botVal)
-				ptr = ptr->leftPtr;
-			else{
-				if(hashes[h] < ptr->topVal){
-					// collision!
-					ibyte = (ptr->measNo)/8;
-					out[ibyte] =  out[ibyte] | ( (0x80) >> ((ptr->measNo)%8) );
-					// check right for overlap, is it still above bot?
-					if (ptr->measNo != m-1){						
-						for(meas=(ptr->measNo)+1; (meas<m) && (hashes[h] >= bot_tree[meas].botVal); meas++){
-							ibyte = meas/8;
-							out[ibyte] =  out[ibyte] | ( (0x80) >> (meas%8) );
-						}
-					}					
-					// check left for overlap, is it still below top?
-					if (ptr->measNo != 0){						
-						for(meas=(ptr->measNo)-1; (meas>=0) && (hashes[h] < bot_tree[meas].topVal); meas--){
-							ibyte = meas/8;
-							out[ibyte] =  out[ibyte] | ( (0x80) >> (meas%8) );
-							if (meas==0){
-								break;
-							}
-						}
-					}
-					// done, no more measurments can be colliding with this hash
-					break;	
-				}
-				else
-					ptr = ptr->rightPtr;
-			}
-		}
+	// Intervals are clipped at the end of the hash range, so tops are sorted as well
+	for (i = 0; i < m; i++)	{
+		if (plan->bot[i]>UINT64_MAX-plan->tau)
+			plan->top[i] = UINT64_MAX;
+		else
+			plan->top[i] = plan->bot[i] + plan->tau;
+	}
 
+	if (variant == SPARSEHASH_FAST && sparsehash_plan_set_lookup(plan, SPARSEHASH_LOOKUP_TREE) != 0){
+		sparsehash_plan_destroy(plan);
+		return NULL;
 	}
 
-	free(bot);
-	free(hashes);
-	free(bot_tree);
+	return plan;
 
 }
 
 
+int sparsehash_plan_set_lookup(sparsehash_plan_t *plan, sparsehash_lookup_t lookup){
 
+	uint32_t bits;
 
-// Data is array of 16-bit integers
-static void sparsehash_compute_uint16(uint16_t *data, uint32_t num_elements, double gamma, uint32_t m, char *out){
-
-	uint32_t h, i, ibyte;
-	uint32_t *seeds;
-	uint64_t hash[2];
-	double tau;
 
+	if (plan->variant == SPARSEHASH_EXACT)
+		return -1;
 
-	seeds = (uint32_t*) malloc(sizeof(uint32_t)*m);
-	for (i = 0; i < m; i++)	{
-		seeds[i] = rand();
+	if (lookup == SPARSEHASH_LOOKUP_TREE && plan->bot_tree == NULL){
+		// Build a binary search tree for the extremes
+		plan->bot_tree = (bst_t*) malloc(sizeof(bst_t)*plan->m);
+		if (plan->bot_tree == NULL)
+			return -1;
+		STATS_START(t_tree);
+		plan->head = buildTree(plan->bot, plan->m, plan->tau, plan->bot_tree);
+		STATS_STOP(SPARSEHASH_PHASE_PLAN_LOOKUP, t_tree);
 	}
-	
-	tau = gamma*UINT64_MAX;
 
-	#pragma omp parallel for private(i,ibyte,h,hash) shared(data)
-	for (i = 0; i < m; i++) { 
-
-		ibyte = i/8;
-
-		for ( h=0; h<num_elements; h++) {
-
-			MurmurHash3_x64_128( &(data[h]), 2, seeds[i], hash );
-			if (hash[0] < tau) {
-				ibyte = i/8;
-				out[ibyte] =  out[ibyte] | ( (0x80) >> (i%8) );
-				break;
-			}
+	if (lookup == SPARSEHASH_LOOKUP_EYTZINGER && plan->eytz_bot == NULL){
+		// Cache-line aligned, so that the prefetched descendants share a line
+		if (posix_memalign((void**)&(plan->eytz_bot), 64, sizeof(uint64_t)*((size_t)plan->m+1)) != 0){
+			plan->eytz_bot = NULL;
+			return -1;
 		}
+		plan->eytz_idx = (uint32_t*) malloc(sizeof(uint32_t)*((size_t)plan->m+1));
+		if (plan->eytz_idx == NULL){
+			free(plan->eytz_bot);
+			plan->eytz_bot = NULL;
+			return -1;
+		}
+		STATS_START(t_eytz);
+		buildEytzinger(plan->bot, plan->m, plan->eytz_bot, plan->eytz_idx);
+		STATS_STOP(SPARSEHASH_PHASE_PLAN_LOOKUP, t_eytz);
+	}
 
+	// About one interval per bucket, unless set by sparsehash_plan_set_bucket_bits
+	if (lookup == SPARSEHASH_LOOKUP_BUCKET && plan->bucket_first == NULL){
+		for (bits=1; bits<BUCKET_MAX_BITS && ((uint64_t)1 << bits) < plan->m; ++bits);
+		return sparsehash_plan_set_bucket_bits(plan, bits);
 	}
 
-	
-	free(seeds);
+	plan->lookup = lookup;
+
+	return 0;
 
 }
 
-static void sparsehash_compute_uint16_medium(uint16_t *data, uint32_t num_elements, double gamma, uint32_t m, char *out){
 
-	uint32_t h, i, ibyte;
-	uint64_t tau;
-	uint64_t *bot, *top;
-	uint64_t hash[2];
-	uint64_t *hashes;
+int sparsehash_plan_set_hash(sparsehash_plan_t *plan, sparsehash_hash_t hash){
 
+	if (hash != SPARSEHASH_HASH_MURMUR3 && hash != SPARSEHASH_HASH_WYHASH)
+		return -1;
 
-	tau = (uint64_t)(gamma*UINT64_MAX);
+	plan->hash = hash;
 
-	bot = (uint64_t*) malloc(sizeof(uint64_t)*m);
-	top = (uint64_t*) malloc(sizeof(uint64_t)*m);
-	for (i = 0; i < m; i++)	{
-		bot[i] = rand_64();
-		if (bot[i]>UINT64_MAX-tau)
-			top[i] = tau-(UINT64_MAX-bot[i]);
-		else
-			top[i] = bot[i] + tau;
-	}
-	
-	hashes = (uint64_t*)malloc(sizeof(uint64_t)*num_elements);
+	return 0;
 
-	#pragma omp parallel for private(h,hash)
-	for ( h=0; h<num_elements; ++h) {
-		MurmurHash3_x64_128 ( &(data[h]), 2, bot[0], hash );
-		hashes[h] = hash[0];
-	}
+}
 
-	#pragma omp parallel for private(i,ibyte,h)
-	for (i = 0; i < m; i++) { 
 
-		for ( h=0; h<num_elements; h++) {
+int sparsehash_plan_set_bucket_bits(sparsehash_plan_t *plan, uint32_t bits){
 
-			if (hashes[h] < top[i] && hashes[h] >= bot[i]) {
-				ibyte = i/8;
-				out[ibyte] =  out[ibyte] | ( (0x80) >> (i%8) );
-				break;
-			}
+	uint32_t *first;
 
-		}
 
-	}
+	if (plan->variant == SPARSEHASH_EXACT || bits < 1 || bits > BUCKET_MAX_BITS)
+		return -1;
 
-	free(bot);
-	free(top);
-	free(hashes);
+	first = (uint32_t*) malloc(sizeof(uint32_t)*(((size_t)1 << bits)+1));
+	if (first == NULL)
+		return -1;
+	STATS_START(t_buckets);
+	buildBuckets(plan->bot, plan->m, bits, first);
+	STATS_STOP(SPARSEHASH_PHASE_PLAN_LOOKUP, t_buckets);
 
-}
+	sparsehash_plan_free(plan, plan->bucket_first);
+	plan->bucket_first = first;
+	plan->bucket_bits = bits;
+	plan->lookup = SPARSEHASH_LOOKUP_BUCKET;
 
+	return 0;
 
-static void sparsehash_compute_uint16_fast(uint16_t *data, uint32_t num_elements, double gamma, uint32_t m, char *out){
+}
 
-	uint32_t h, i, ibyte, meas;
-	uint64_t tau;
-	uint64_t *bot;
-	uint64_t hash[2];
-	uint64_t *hashes;
-	bst_t *bot_tree, *head, *ptr;
 
+size_t sparsehash_plan_lookup_bytes(const sparsehash_plan_t *plan){
 
-	tau = (uint64_t)(gamma*UINT64_MAX);
+	switch (plan->lookup){
 
-	// Generate bottoms of intervals
-	bot = (uint64_t*) malloc(sizeof(uint64_t)*m);
-	for (i = 0; i < m; i++)	{
-		bot[i] = rand_64();
-	}
+		case SPARSEHASH_LOOKUP_TREE : return sizeof(bst_t)*(size_t)plan->m;
+		case SPARSEHASH_LOOKUP_BINARY : return 0;
+		case SPARSEHASH_LOOKUP_EYTZINGER : return (sizeof(uint64_t)+sizeof(uint32_t))*((size_t)plan->m+1);
+		case SPARSEHASH_LOOKUP_BUCKET : return sizeof(uint32_t)*(((size_t)1 << plan->bucket_bits)+1);
+		case SPARSEHASH_LOOKUP_SWEEP : return 0;
 
-	// Compute hashes
-	hashes = (uint64_t*)malloc(sizeof(uint64_t)*num_elements);
-	//#pragma omp parallel for private(h,hash)
-	for ( h=0; h<num_elements; ++h) {
-		MurmurHash3_x64_128 ( &(data[h]), 2, bot[0], hash );
-		hashes[h] = hash[0];
 	}
 
-	// Sort bottoms
-	qsort(bot, m, sizeof(uint64_t), cmpfunc);
-
-	// Build a binary search tree for the extremes
-	bot_tree = (bst_t*) malloc(sizeof(bst_t)*m);
-	head = buildTree(bot, m, tau, bot_tree);
-
-	// Compute measurements by traversing the tree
-	//#pragma omp parallel for private(h,hash,ptr,ibyte,meas)
-	for ( h=0; h<num_elements; ++h){
-
-		ptr = head;
-		while(ptr!=NULL){
-			if(hashes[h] < ptr->botVal)
-				ptr = ptr->leftPtr;
-			else{
-				if(hashes[h] < ptr->topVal){
-					// collision!
-					ibyte = (ptr->measNo)/8;
-					out[ibyte] =  out[ibyte] | ( (0x80) >> ((ptr->measNo)%8) );
-					// check right for overlap, is it still above bot?
-					if (ptr->measNo != m-1){						
-						for(meas=(ptr->measNo)+1; (meas<m) && (hashes[h] >= bot_tree[meas].botVal); meas++){
-							ibyte = meas/8;
-							out[ibyte] =  out[ibyte] | ( (0x80) >> (meas%8) );
-						}
-					}					
-					// check left for overlap, is it still below top?
-					if (ptr->measNo != 0){						
-						for(meas=(ptr->measNo)-1; (meas>=0) && (hashes[h] < bot_tree[meas].topVal); meas--){
-							ibyte = meas/8;
-							out[ibyte] =  out[ibyte] | ( (0x80) >> (meas%8) );
-							if (meas==0){
-								break;
-							}
-						}
-					}
-					// done, no more measurments can be colliding with this hash
-					break;	
-				}
-				else
-					ptr = ptr->rightPtr;
-			}
-		}
-
-	}
-
-	free(bot);
-	free(hashes);
-	free(bot_tree);
+	return 0;
 
 }
 
 
+void sparsehash_plan_destroy(sparsehash_plan_t *plan){
 
-// Data is array of 32-bit integers
-static void sparsehash_compute_uint32(uint32_t *data, uint32_t num_elements, double gamma, uint32_t m, char *out){
+	if (plan == NULL)
+		return;
 
-	uint32_t h, i, ibyte;
-	uint32_t *seeds;
-	uint64_t hash[2];
-	double tau;
+	sparsehash_plan_free(plan, plan->seeds);
+	sparsehash_plan_free(plan, plan->bot);
+	sparsehash_plan_free(plan, plan->top);
+	sparsehash_plan_free(plan, plan->bot_tree);
+	sparsehash_plan_free(plan, plan->eytz_bot);
+	sparsehash_plan_free(plan, plan->eytz_idx);
+	sparsehash_plan_free(plan, plan->bucket_first);
 
+	if (plan->map != NULL)
+		munmap(plan->map, plan->map_size);
 
-	seeds = (uint32_t*) malloc(sizeof(uint32_t)*m);
-	for (i = 0; i < m; i++)	{
-		seeds[i] = rand();
-	}
-	
-	tau = gamma*UINT64_MAX;
+	free(plan);
 
-	#pragma omp parallel for private(i,ibyte,h,hash) shared(data)
-	for (i = 0; i < m; i++) { 
+}
 
-		for ( h=0; h<num_elements; h++) {
 
-			MurmurHash3_x64_128( &(data[h]), 4, seeds[i], hash );
-			if (hash[0] < tau) {
-				ibyte = i/8;
-				out[ibyte] =  out[ibyte] | ( (0x80) >> (i%8) );
-				break;
-			}
+int sparsehash_update(const sparsehash_plan_t *plan, char *sketch, void *data, uint32_t num_elements, uint16_t element_size, uint16_t *str_len){
 
-		}
+	uint64_t *hashes = NULL;
 
-	}
 
-	free(seeds);
+	if (num_elements == 0)
+		return 0;
 
-}
+	if (plan->variant != SPARSEHASH_EXACT){
+		hashes = (uint64_t*)malloc(sizeof(uint64_t)*num_elements);
+		if (hashes == NULL)
+			return -1;
+	}
 
+	sparsehash_kernel(plan, data, num_elements, KEY_SIZE(element_size), str_len, hashes, sketch);
 
-static void sparsehash_compute_uint32_medium(uint32_t *data, uint32_t num_elements, double gamma, uint32_t m, char *out){
+	free(hashes);
 
-	uint32_t h, i, ibyte, hash_tmp;
-	uint64_t tau;
-	uint64_t *bot, *top;
-	uint64_t hash[2];
-	uint64_t *hashes;
+	return 0;
 
+}
 
-	tau = (uint64_t)(gamma*UINT64_MAX);
 
-	bot = (uint64_t*) malloc(sizeof(uint64_t)*m);
-	top = (uint64_t*) malloc(sizeof(uint64_t)*m);
-	for (i = 0; i < m; i++)	{
-		bot[i] = rand_64();
-		if (bot[i]>UINT64_MAX-tau)
-			bot[i] = UINT64_MAX-tau;
-		else
-			top[i] = bot[i] + tau;
-	}
-	
-	hashes = (uint64_t*)malloc(sizeof(uint64_t)*num_elements);
+int sparsehash_sketch_with_plan(const sparsehash_plan_t *plan, void *data, uint32_t num_elements, uint16_t element_size, uint16_t *str_len, char *out){
 
-	#pragma omp parallel for private(h,hash)
-	for ( h=0; h<num_elements; ++h) {
-		MurmurHash3_x64_128 ( &(data[h]), 4, bot[0], hash );
-		hashes[h] = hash[0];
-	}
+	memset(out,0,plan->mbytes);
+	return sparsehash_update(plan, out, data, num_elements, element_size, str_len);
 
+}
 
-	#pragma omp parallel for private(i,ibyte,h)
-	for (i = 0; i < m; i++) { 
 
-		ibyte = i/8;
+int sparsehash_sketch_keys(const sparsehash_plan_t *plan, const void *keys, uint32_t num_elements, uint32_t key_size, char *out){
 
-		for ( h=0; h<num_elements; h++) {
+	uint64_t *hashes = NULL;
 
-			if (hashes[h] < top[i] && hashes[h] >= bot[i]) {
-				out[ibyte] =  out[ibyte] | ( (0x80) >> (i%8) );
-				break;
-			}
 
-		}
+	memset(out,0,plan->mbytes);
 
+	if (plan->variant != SPARSEHASH_EXACT && num_elements > 0){
+		hashes = (uint64_t*)malloc(sizeof(uint64_t)*num_elements);
+		if (hashes == NULL)
+			return -1;
 	}
 
-	free(bot);
-	free(top);
+	sparsehash_kernel(plan, keys, num_elements, key_size, NULL, hashes, out);
+
 	free(hashes);
 
+	return 0;
+
 }
 
 
-static void sparsehash_compute_uint32_fast(uint32_t *data, uint32_t num_elements, double gamma, uint32_t m, char *out){
+static int sparsehash_sketch_variant(void *data, uint32_t num_elements, uint16_t element_size, uint16_t *str_len, uint32_t seed, double gamma, uint32_t m, sparsehash_variant_t variant, char *out){
 
-	uint32_t h, i, ibyte, meas;
-	uint64_t tau;
-	uint64_t *bot;
-	uint64_t hash[2];
-	uint64_t *hashes;
-	bst_t *bot_tree, *head, *ptr;
+	sparsehash_plan_t *plan;
+	int ret;
 
 
-	tau = (uint64_t)(gamma*UINT64_MAX);
+	plan = sparsehash_plan_create(seed, gamma, m, variant);
+	if (plan == NULL)
+		return -1;
+	ret = sparsehash_sketch_with_plan(plan, data, num_elements, element_size, str_len, out);
+	sparsehash_plan_destroy(plan);
 
-	// Generate bottoms of intervals
-	bot = (uint64_t*) malloc(sizeof(uint64_t)*m);
-	for (i = 0; i < m; i++)	{
-		bot[i] = rand_64();
-	}
+	return ret;
 
-	// Compute hashes
-	hashes = (uint64_t*)malloc(sizeof(uint64_t)*num_elements);
-	//#pragma omp parallel for private(h,hash)
-	for ( h=0; h<num_elements; ++h) {
-		MurmurHash3_x64_128 ( &(data[h]), 4, bot[0], hash );
-		hashes[h] = hash[0];
-	}
+}
 
-	// Sort bottoms
-	qsort(bot, m, sizeof(uint64_t), cmpfunc);
-
-	// Build a binary search tree for the extremes
-	bot_tree = (bst_t*) malloc(sizeof(bst_t)*m);
-	head = buildTree(bot, m, tau, bot_tree);
-
-	// Compute measurements by traversing the tree
-	//#pragma omp parallel for private(h,hash,ptr,ibyte,meas)
-	for ( h=0; h<num_elements; ++h){
-
-		ptr = head;
-		while(ptr!=NULL){
-			if(hashes[h] < ptr->botVal)
-				ptr = ptr->leftPtr;
-			else{
-				if(hashes[h] < ptr->topVal){
-					// collision!
-					ibyte = (ptr->measNo)/8;
-					out[ibyte] =  out[ibyte] | ( (0x80) >> ((ptr->measNo)%8) );
-					// check right for overlap, is it still above bot?
-					if (ptr->measNo != m-1){						
-						for(meas=(ptr->measNo)+1; (meas<m) && (hashes[h] >= bot_tree[meas].botVal); meas++){
-							ibyte = meas/8;
-							out[ibyte] =  out[ibyte] | ( (0x80) >> (meas%8) );
-						}
-					}					
-					// check left for overlap, is it still below top?
-					if (ptr->measNo != 0){						
-						for(meas=(ptr->measNo)-1; (meas>=0) && (hashes[h] < bot_tree[meas].topVal); meas--){
-							ibyte = meas/8;
-							out[ibyte] =  out[ibyte] | ( (0x80) >> (meas%8) );
-							if (meas==0){
-								break;
-							}
-						}
-					}
-					// done, no more measurments can be colliding with this hash
-					break;	
-				}
-				else
-					ptr = ptr->rightPtr;
-			}
-		}
 
-	}
+int sparsehash_sketch(void *data, uint32_t num_elements, uint16_t element_size, uint16_t *str_len, uint32_t seed, double gamma, uint32_t m, char *out){
 
-	free(bot);
-	free(hashes);
-	free(bot_tree);
+	return sparsehash_sketch_variant(data, num_elements, element_size, str_len, seed, gamma, m, SPARSEHASH_EXACT, out);
 
 }
 
 
+int sparsehash_sketch_medium(void *data, uint32_t num_elements, uint16_t element_size, uint16_t *str_len, uint32_t seed, double gamma, uint32_t m, char *out){
 
+	return sparsehash_sketch_variant(data, num_elements, element_size, str_len, seed, gamma, m, SPARSEHASH_MEDIUM, out);
 
+}
 
-void sparsehash_sketch(void *data, uint32_t num_elements, uint16_t element_size, uint16_t *str_len, uint32_t seed, double gamma, uint32_t m, char *out){
 
-	uint32_t mbytes;
+int sparsehash_sketch_fast(void *data, uint32_t num_elements, uint16_t element_size, uint16_t *str_len, uint32_t seed, double gamma, uint32_t m, char *out){
 
+	return sparsehash_sketch_variant(data, num_elements, element_size, str_len, seed, gamma, m, SPARSEHASH_FAST, out);
 
-	srand(seed);
+}
 
-	mbytes = m/8;
-	if (m%8!=0)
-		mbytes++; 
 
-	memset(out,0,mbytes);
+int sparsehash_sketch_batch(const sparsehash_plan_t *plan, void *data, const uint64_t *offsets, uint32_t num_sets, uint16_t element_size, uint16_t *str_len, char *out){
 
-	switch (element_size){
+	uint32_t mbytes, s;
+	uint64_t u, num_units, begin;
+	size_t stride;
+	batch_unit_t *units;
+	int failed = 0;
 
-		case 1 : sparsehash_compute_char((char**)data, num_elements, str_len, gamma, m, out); break;
-		case 2 : sparsehash_compute_uint16((uint16_t*)data, num_elements, gamma, m, out); break;
-		case 4 : sparsehash_compute_uint32((uint32_t*)data, num_elements, gamma, m, out); break;
 
-	}
+	mbytes = plan->mbytes;
 
-}
+	memset(out,0,(size_t)mbytes*num_sets);
 
+	// Pointers for strings, values for integers
+	stride = (element_size==1) ? sizeof(char*) : element_size;
+	// Split the sets in units of at most BATCH_CHUNK elements
+	num_units = 0;
+	for (s=0; s<num_sets; ++s){
+		num_units += (offsets[s+1]-offsets[s]+BATCH_CHUNK-1)/BATCH_CHUNK;
+	}
 
-void sparsehash_sketch_medium(void *data, uint32_t num_elements, uint16_t element_size, uint16_t *str_len, uint32_t seed, double gamma, uint32_t m, char *out){
+	units = (batch_unit_t*) malloc(sizeof(batch_unit_t)*num_units + 1);
+	if (units == NULL)
+		return -1;
+	u = 0;
+	for (s=0; s<num_sets; ++s){
+		for (begin=offsets[s]; begin<offsets[s+1]; begin+=BATCH_CHUNK){
+			units[u].begin = begin;
+			units[u].end = (offsets[s+1]-begin > BATCH_CHUNK) ? begin+BATCH_CHUNK : offsets[s+1];
+			units[u].set = s;
+			units[u].split = (offsets[s+1]-offsets[s] > BATCH_CHUNK);
+			u++;
+		}
+	}
 
-	uint32_t mbytes;
+	// Largest units first, idle threads then grab the small ones
+	qsort(units, num_units, sizeof(batch_unit_t), cmpunit);
 
+	STATS_CALLER(acc);
+	#pragma omp parallel private(u)
+	{
 
-	srand(seed);
+		uint32_t b;
+		uint64_t *hashes = NULL;
+		char *partial, *dest;
 
-	mbytes = m/8;
-	if (m%8!=0)
-		mbytes++; 
+		if (plan->variant != SPARSEHASH_EXACT)
+			hashes = (uint64_t*)malloc(sizeof(uint64_t)*BATCH_CHUNK);
+		partial = (char*)malloc(mbytes);
+		if ((plan->variant != SPARSEHASH_EXACT && hashes == NULL) || partial == NULL){
+			#pragma omp atomic write
+			failed = 1;
+		}
 
-	memset(out,0,mbytes);
+		// Every thread reaches the loop, the ones without buffers only skip their units
+		#pragma omp for schedule(dynamic,1)
+		for (u=0; u<num_units; ++u){
 
-	switch (element_size){
+			if (partial == NULL || (plan->variant != SPARSEHASH_EXACT && hashes == NULL))
+				continue;
 
-		case 1 : sparsehash_compute_char_medium((char**)data, num_elements, str_len, gamma, m, out); break;
-		case 2 : sparsehash_compute_uint16_medium((uint16_t*)data, num_elements, gamma, m, out); break;
-		case 4 : sparsehash_compute_uint32_medium((uint32_t*)data, num_elements, gamma, m, out); break;
+			dest = out + (size_t)units[u].set*mbytes;
 
-	}
+			if (units[u].split){
+				// Several threads may be sketching chunks of this set
+				memset(partial,0,mbytes);
+				sparsehash_kernel(plan, (char*)data + units[u].begin*stride, units[u].end-units[u].begin, KEY_SIZE(element_size), (element_size==1) ? str_len+units[u].begin : NULL, hashes, partial);
+				for (b=0; b<mbytes; ++b){
+					if (partial[b]){
+						#pragma omp atomic
+						dest[b] |= partial[b];
+					}
+				}
+			}
+			else
+				sparsehash_kernel(plan, (char*)data + units[u].begin*stride, units[u].end-units[u].begin, KEY_SIZE(element_size), (element_size==1) ? str_len+units[u].begin : NULL, hashes, dest);
 
-}
+		}
 
+		free(hashes);
+		free(partial);
+		STATS_FOLD(acc);
 
-void sparsehash_sketch_fast(void *data, uint32_t num_elements, uint16_t element_size, uint16_t *str_len, uint32_t seed, double gamma, uint32_t m, char *out){
+	}
+	STATS_JOIN(acc);
 
-	uint32_t mbytes;
+	free(units);
 
+	return failed ? -1 : 0;
 
-	srand(seed);
+}
 
-	mbytes = m/8;
-	if (m%8!=0)
-		mbytes++; 
 
-	memset(out,0,mbytes);
+void sparsehash_merge(char *out, const char *sketches, uint32_t num_sketches, uint32_t bit_len){
 
-	switch (element_size){
+	uint32_t s;
+	size_t mbytes, first, len;
 
-		case 1 : sparsehash_compute_char_fast((char**)data, num_elements, str_len, gamma, m, out); break;
-		case 2 : sparsehash_compute_uint16_fast((uint16_t*)data, num_elements, gamma, m, out); break;
-		case 4 : sparsehash_compute_uint32_fast((uint32_t*)data, num_elements, gamma, m, out); break;
 
+	mbytes = (bit_len+7)/8;
+	if (num_sketches == 0){
+		memset(out,0,mbytes);
+		return;
+	}
+
+	// Tiles of out stay in cache while every input is streamed through
+	for (first=0; first<mbytes; first+=MERGE_TILE){
+		len = (mbytes-first > MERGE_TILE) ? MERGE_TILE : mbytes-first;
+		memcpy(out+first, sketches+first, len);
+		for (s=1; s<num_sketches; ++s)
+			simd_or((uint8_t*)out+first, (const uint8_t*)sketches + (size_t)s*mbytes + first, len);
 	}
 
 }
@@ -611,8 +500,9 @@ void sparsehash_sketch_fast(void *data, uint32_t num_elements, uint16_t element_
 double sparsehash_sim_J(const char *sketch_1, const char *sketch_2, uint32_t bit_len){
 
 	uint32_t nzz=0, nz_1=0, nz_2=0;
-	uint32_t i, byte_len, extra_bits;
+	uint32_t byte_len, extra_bits;
 	uint8_t not_temp_1, not_temp_2;
+	uint64_t counts[3];
 	double Jaccard;
 
 
@@ -627,17 +517,11 @@ double sparsehash_sim_J(const char *sketch_1, const char *sketch_2, uint32_t bit
 		nz_2 += __builtin_popcount(not_temp_2);
 	}
 
-	for (i=0; i<byte_len; ++i){
-		
-		not_temp_1 = ~(sketch_1[i]);
-		not_temp_2 = ~(sketch_2[i]);
-
-		//nzz += __builtin_popcount( ~(sketch_1[i] | sketch_2[i]) );
-		nzz += __builtin_popcount( not_temp_1 & not_temp_2 );
-		nz_1 += __builtin_popcount(not_temp_1);
-		nz_2 += __builtin_popcount(not_temp_2);
-
-	}
+	// Zeros of the full bytes from the ones of sketch_1, sketch_2 and of their OR
+	simd_popcount_or((const uint8_t*)sketch_1, (const uint8_t*)sketch_2, byte_len, counts);
+	nz_1 += 8*byte_len - counts[0];
+	nz_2 += 8*byte_len - counts[1];
+	nzz += 8*byte_len - counts[2];
 
 	Jaccard = log( ((double)(nz_1)*nz_2)/((double)(nzz)*bit_len) ) / log( (double)(nzz)/bit_len );
 
@@ -649,7 +533,7 @@ double sparsehash_sim_J(const char *sketch_1, const char *sketch_2, uint32_t bit
 uint32_t sparsehash_dist_H(const char *sketch_1, const char *sketch_2, uint32_t bit_len){
 
 	uint32_t hamming=0;
-	uint32_t i, byte_len, extra_bits;
+	uint32_t byte_len, extra_bits;
 	uint8_t temp;
 
 
@@ -661,18 +545,54 @@ uint32_t sparsehash_dist_H(const char *sketch_1, const char *sketch_2, uint32_t
 		hamming += __builtin_popcount(temp);
 	}
 
+	hamming += simd_popcount_xor((const uint8_t*)sketch_1, (const uint8_t*)sketch_2, byte_len);
 
-	for (i=0;i<byte_len;++i){
+	return hamming;
+	
+}
 
-		temp = (sketch_1[i]^sketch_2[i]);
 
-		hamming += __builtin_popcount(temp);
+uint32_t sparsehash_dist_H_bounded(const char *sketch_1, const char *sketch_2, uint32_t bit_len, uint32_t max_dist){
+
+	uint32_t hamming=0;
+	uint32_t byte_len, extra_bits;
+	uint8_t temp;
 
 
+	byte_len = bit_len/8;
+	extra_bits = bit_len%8;
+
+	if (extra_bits!=0){
+		temp = (sketch_1[byte_len] | (0xFF >> extra_bits))^(sketch_2[byte_len] | (0xFF >> extra_bits));
+		hamming += __builtin_popcount(temp);
+		if (hamming > max_dist)
+			return hamming;
 	}
 
+	hamming += simd_popcount_xor_bounded((const uint8_t*)sketch_1, (const uint8_t*)sketch_2, byte_len, max_dist-hamming);
+
 	return hamming;
-	
+
+}
+
+
+void sparsehash_dist_H_bounded_many(const char *sketch, const char *sketches, uint32_t num_sketches, uint32_t bit_len, uint32_t max_dist, uint32_t *out){
+
+	uint32_t s, mbytes = (bit_len+7)/8;
+
+
+	#pragma omp parallel for schedule(static)
+	for (s=0; s<num_sketches; ++s){
+		// Far sketches are left after their first block, the stride defeats the hardware prefetcher
+		if (s+BOUNDED_PREFETCH < num_sketches){
+			const char *next = sketches + (size_t)(s+BOUNDED_PREFETCH)*mbytes;
+			uint32_t line;
+			for (line=0; line<BOUNDED_PREFETCH_BYTES && line<mbytes; line+=64)
+				__builtin_prefetch(next + line);
+		}
+		out[s] = sparsehash_dist_H_bounded(sketch, sketches + (size_t)s*mbytes, bit_len, max_dist);
+	}
+
 }
 
 
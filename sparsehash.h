@@ -1,22 +1,282 @@
+#ifndef _SPARSEHASH_H_
+#define _SPARSEHASH_H_
+
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
 #include <math.h>
 #include "MurmurHash3.h"
+#include "hashfn.h"
+#include "utils.h"
+
+
+// Sketching algorithm, see the corresponding sparsehash_sketch* function
+typedef enum{
+
+	SPARSEHASH_EXACT,
+	SPARSEHASH_MEDIUM,
+	SPARSEHASH_FAST
+
+} sparsehash_variant_t;
+
+// Search structure over the intervals of the fast version
+typedef enum{
+
+	SPARSEHASH_LOOKUP_TREE,		// bst_t built by buildTree
+	SPARSEHASH_LOOKUP_BINARY,	// same descent computed on the sorted arrays, no extra memory
+	SPARSEHASH_LOOKUP_EYTZINGER,	// bottoms in Eytzinger order, branchless descent with prefetching
+	SPARSEHASH_LOOKUP_BUCKET,	// direct-address buckets on the top bits of the hash, then a short scan
+	SPARSEHASH_LOOKUP_SWEEP		// radix sort of the hashes and one merge with the intervals, for n comparable to m or larger
+
+} sparsehash_lookup_t;
+
+// Layout of an input file
+typedef enum{
+
+	SPARSEHASH_INPUT_LINES,		// one set, one string per line
+	SPARSEHASH_INPUT_SETS,		// one set per line, strings separated by spaces or tabs
+	SPARSEHASH_INPUT_U16,		// one set, raw little-endian integers
+	SPARSEHASH_INPUT_U32,
+	SPARSEHASH_INPUT_U64
+
+} sparsehash_format_t;
+
+// Input file mapped read-only, in the CSR layout of sparsehash_sketch_batch with no copies of the elements:
+// integers are read in place, strings are pointers and lengths into the mapping
+typedef struct{
+
+	void *map;
+	size_t size;
+	uint32_t num_sets;
+	uint64_t *offsets;		// set s holds elements offsets[s] to offsets[s+1]-1
+	uint16_t element_size;
+	void *data;
+	uint16_t *str_len;
+
+} sparsehash_input_t;
+
+// Optional tables of a sketch database
+#define SPARSEHASH_DB_IDS 1			// 64-bit ID of every record
+#define SPARSEHASH_DB_POPCOUNTS 2	// ones of every sketch
+
+// Sketch database being written, see sparsehash_db_create
+typedef struct{
+
+	FILE *fp;
+	sparsehash_variant_t variant;
+	uint32_t seed;
+	double gamma;
+	uint32_t m;
+	sparsehash_hash_t hash;
+	uint32_t hash_seed;
+	uint32_t mbytes;
+	uint32_t stride;
+	uint32_t flags;
+	uint64_t num_records;
+	uint64_t capacity;
+	char *record;			// one zero-padded record
+	uint64_t *ids;
+	uint32_t *popcounts;
+	uint64_t data_checksum;
+	int err;
+
+} sparsehash_db_writer_t;
+
+// Sketch database mapped read-only: plan parameters, then num_records sketches at a fixed stride, a multiple of 64 bytes.
+// Pages are shared by all the processes mapping the file
+typedef struct{
+
+	sparsehash_variant_t variant;
+	uint32_t seed;
+	double gamma;
+	uint32_t m;
+	sparsehash_hash_t hash;
+	uint32_t hash_seed;
+	uint32_t stride;
+	uint64_t num_records;
+	const char *sketches;		// record r at sketches + r*stride, 64-byte aligned
+	const uint64_t *ids;		// NULL if not stored
+	const uint32_t *popcounts;	// NULL if not stored
+	void *map;
+	size_t map_size;
+
+} sparsehash_db_t;
+
+// Comparison of two sketches
+typedef enum{
+
+	SPARSEHASH_MEASURE_JACCARD,	// sparsehash_sim_J
+	SPARSEHASH_MEASURE_HAMMING	// sparsehash_dist_H
+
+} sparsehash_measure_t;
+
+// Pair of sketches i < j and their comparison
+typedef struct{
+
+	uint32_t i;
+	uint32_t j;
+	double value;
 
+} sparsehash_pair_t;
 
-// Compute m-bits sketch for data. data must be an array of num_elements integers of size element_size bytes (2 or 4) 
+// Stored sketch returned by a nearest-neighbour query
+typedef struct{
+
+	uint32_t index;		// position in the collection
+	uint32_t dist;		// Hamming distance, the ranking key
+	double sim;			// Jaccard estimate
+
+} sparsehash_neighbor_t;
+
+// Seeds and intervals for a given (seed, gamma, m, variant), drawn with a counter-based generator.
+// A plan is read-only after creation, so it can be shared by any number of threads
+typedef struct sparsehash_plan{
+
+	sparsehash_variant_t variant;
+	uint32_t seed;
+	double gamma;
+	uint32_t m;
+	uint32_t mbytes;
+	uint64_t tau;
+	sparsehash_hash_t hash;
+	uint32_t hash_seed;		// hash seed of the medium and fast versions
+	uint32_t *seeds;		// per-measurement hash seeds of the exact version
+	uint64_t *bot;			// sorted bottoms of intervals (medium and fast)
+	uint64_t *top;			// tops of intervals, clipped at UINT64_MAX
+	sparsehash_lookup_t lookup;
+	bst_t *bot_tree;		// search tree over the intervals (fast)
+	bst_t *head;
+	uint64_t *eytz_bot;		// Eytzinger layout of bot, m+1 entries
+	uint32_t *eytz_idx;		// position in bot of each entry of eytz_bot
+	uint32_t bucket_bits;
+	uint32_t *bucket_first;	// first interval of each of the 2^bucket_bits buckets, plus m
+	void *map;				// file mapping holding the tables, NULL if allocated
+	size_t map_size;
+
+} sparsehash_plan_t;
+
+
+// Create a plan, NULL if out of memory
+sparsehash_plan_t* sparsehash_plan_create(uint32_t seed, double gamma, uint32_t m, sparsehash_variant_t variant);
+
+// Destroy a plan, created or mapped
+void sparsehash_plan_destroy(sparsehash_plan_t *plan);
+
+// Select the hash function of the elements, SPARSEHASH_HASH_MURMUR3 by default. Returns 0 on success
+int sparsehash_plan_set_hash(sparsehash_plan_t *plan, sparsehash_hash_t hash);
+
+// Select the search structure of a fast plan, building it if needed. Returns 0 on success
+int sparsehash_plan_set_lookup(sparsehash_plan_t *plan, sparsehash_lookup_t lookup);
+
+// Select SPARSEHASH_LOOKUP_BUCKET with 2^bits buckets (1 to 30), the default has about one interval per bucket.
+// Returns 0 on success
+int sparsehash_plan_set_bucket_bits(sparsehash_plan_t *plan, uint32_t bits);
+
+// Memory taken by the search structure in use, on top of the 16 bytes per interval of bot and top.
+// SPARSEHASH_LOOKUP_SWEEP has no structure but allocates 8 bytes per element at each sketch
+size_t sparsehash_plan_lookup_bytes(const sparsehash_plan_t *plan);
+
+// Write the tables of plan to a plan file. Returns 0 on success
+int sparsehash_plan_save(const sparsehash_plan_t *plan, const char *path);
+
+// Map a plan file read-only, pages are shared by all the processes mapping it. NULL if missing or invalid.
+// Fast plans use SPARSEHASH_LOOKUP_EYTZINGER if saved with it, SPARSEHASH_LOOKUP_BINARY otherwise
+sparsehash_plan_t* sparsehash_plan_map(const char *path);
+
+// Compute sketch of data with the seeds and intervals of plan, out holds plan->mbytes bytes. Reentrant.
+// 0 if successful, -1 if out of memory, as for sparsehash_update and sparsehash_sketch_keys
+int sparsehash_sketch_with_plan(const sparsehash_plan_t *plan, void *data, uint32_t num_elements, uint16_t element_size, uint16_t *str_len, char *out);
+
+// OR num_elements more elements into sketch, a sketch of a set built by sparsehash_sketch_with_plan with the same plan.
+// The result is the sketch of the union, at the cost of the new elements only. Not safe on the same sketch from several threads
+int sparsehash_update(const sparsehash_plan_t *plan, char *sketch, void *data, uint32_t num_elements, uint16_t element_size, uint16_t *str_len);
+
+// Compute sketch of num_elements packed keys of key_size bytes. Keys of 1, 2, 4 and 8 bytes are integers
+// (same sketch as element_size 2, 4 and 8), other sizes such as 16-byte UUIDs are hashed as byte strings
+int sparsehash_sketch_keys(const sparsehash_plan_t *plan, const void *keys, uint32_t num_elements, uint32_t key_size, char *out);
+
+// Compute m-bits sketch for data. data must be an array of num_elements integers of size element_size bytes (2, 4 or 8) 
 // or an array of num_elements strings of lengths str_len (element_size=1)
-// O(nm) hash functions, O(nm) comparisons
-void sparsehash_sketch(void *data, uint32_t num_elements, uint16_t element_size, uint16_t *str_len, uint32_t seed, double gamma, uint32_t m, char *out);
+// O(nm) hash functions, O(nm) comparisons. 0 if successful, -1 if out of memory, as the two versions below
+int sparsehash_sketch(void *data, uint32_t num_elements, uint16_t element_size, uint16_t *str_len, uint32_t seed, double gamma, uint32_t m, char *out);
 
 // Medium-speed version of sparsehash with window
 // O(n) hash functions, O(nm) comparisons
-void sparsehash_sketch_medium(void *data, uint32_t num_elements, uint16_t element_size, uint16_t *str_len, uint32_t seed, double gamma, uint32_t m, char *out);
+int sparsehash_sketch_medium(void *data, uint32_t num_elements, uint16_t element_size, uint16_t *str_len, uint32_t seed, double gamma, uint32_t m, char *out);
 
 // Fast version of sparsehash with window
 // O(n) hash functions, O(nlogm) comparisons
-void sparsehash_sketch_fast(void *data, uint32_t num_elements, uint16_t element_size, uint16_t *str_len, uint32_t seed, double gamma, uint32_t m, char *out);
+int sparsehash_sketch_fast(void *data, uint32_t num_elements, uint16_t element_size, uint16_t *str_len, uint32_t seed, double gamma, uint32_t m, char *out);
+
+// Variant and OpenMP threads picked by the cost model, with the predicted time in seconds (-1 if there is no model)
+typedef struct{
+
+	sparsehash_variant_t variant;
+	int threads;
+	double seconds;
+
+} sparsehash_auto_choice_t;
+
+// Measure the costs of the model on this host and save them to path, NULL for the default cache
+// ($SPARSEHASH_CALIBRATION, or ~/.cache/sparsehash/calibration-<hostname>). 0 on success, -1 if not saved
+int sparsehash_auto_calibrate(const char *path);
+
+// Fastest variant and thread count for a sketch with a new plan, among the variants giving the same sketches as
+// reference: the exact version alone, or medium and fast, whose sketches are bit-identical. Sketches of the exact
+// version cannot be compared with the others. The model is read from the cache, or calibrated and cached, on the first call.
+// If the calibration runs out of memory, the choice is the fast version (exact if reference is) on all the threads
+void sparsehash_auto_choose(uint32_t num_elements, uint16_t element_size, const uint16_t *str_len, double gamma, uint32_t m, sparsehash_variant_t reference, sparsehash_auto_choice_t *choice);
+
+// Same arguments as sparsehash_sketch, with the variant and threads of sparsehash_auto_choose, stored in chosen if not NULL.
+// 0 if successful, -1 if out of memory
+int sparsehash_sketch_auto(void *data, uint32_t num_elements, uint16_t element_size, uint16_t *str_len, uint32_t seed, double gamma, uint32_t m, sparsehash_variant_t reference, sparsehash_auto_choice_t *chosen, char *out);
+
+// Sketch num_sets sets in CSR layout, set s holds elements offsets[s] to offsets[s+1]-1 of data (and str_len).
+// out must hold num_sets sketches of plan->mbytes bytes each, sketch of set s is the same as sparsehash_sketch_with_plan.
+// 0 if successful, -1 if out of memory
+int sparsehash_sketch_batch(const sparsehash_plan_t *plan, void *data, const uint64_t *offsets, uint32_t num_sets, uint16_t element_size, uint16_t *str_len, char *out);
+
+// OR of num_sketches contiguous sketches of bit_len bits into out. Sketches of disjoint parts of a set with the same
+// plan merge into the sketch of the whole set
+void sparsehash_merge(char *out, const char *sketches, uint32_t num_sketches, uint32_t bit_len);
+
+// Sketch of the packed keys of key_size bytes in the file at path, as sparsehash_sketch_keys on the whole file.
+// The file is split among num_workers forked processes, each reading and sketching its shard in chunks of
+// bounded memory, and their sketches are merged. 0 if successful, -1 otherwise
+int sparsehash_sketch_file_sharded(const sparsehash_plan_t *plan, const char *path, uint32_t key_size, uint32_t num_workers, char *out);
+
+// Map the file at path, NULL if missing, malformed or with strings over 65535 bytes
+sparsehash_input_t* sparsehash_input_map(const char *path, sparsehash_format_t format);
+
+void sparsehash_input_unmap(sparsehash_input_t *in);
+
+// Start a sketch database at path for sketches made with plan, flags are SPARSEHASH_DB_* tables to store. NULL if failed
+sparsehash_db_writer_t* sparsehash_db_create(const char *path, const sparsehash_plan_t *plan, uint32_t flags);
+
+// Append num_sketches contiguous sketches of plan->mbytes bytes. ids may be NULL, records are then numbered from 0.
+// 0 if successful, -1 otherwise
+int sparsehash_db_append(sparsehash_db_writer_t *db, const char *sketches, uint32_t num_sketches, const uint64_t *ids);
+
+// Write the tables and the header with the checksums, and free db. 0 if the whole database was written, -1 otherwise
+int sparsehash_db_close(sparsehash_db_writer_t *db);
+
+// Map a sketch database, NULL if missing or if the header is invalid. The data is not read, see sparsehash_db_verify
+sparsehash_db_t* sparsehash_db_map(const char *path);
+
+void sparsehash_db_unmap(sparsehash_db_t *db);
+
+// 0 if the sketches and tables match the checksum in the header, -1 otherwise
+int sparsehash_db_verify(const sparsehash_db_t *db);
+
+// Nonzero if the sketches of db can be compared with the sketches of plan: same seed, gamma, m and hash, and both exact
+// or both medium/fast, since medium and fast sketches are bit-identical
+int sparsehash_db_compatible(const sparsehash_db_t *db, const sparsehash_plan_t *plan);
+
+// Sketch of record r, usable with sparsehash_sim_J and sparsehash_dist_H with bit_len db->m
+static inline const char* sparsehash_db_sketch(const sparsehash_db_t *db, uint64_t r){
+	return db->sketches + r*db->stride;
+}
 
 // Compute Jaccard estimate from two sketches
 double sparsehash_sim_J(const char *sketch_1, const char *sketch_2, uint32_t bit_len);
@@ -24,5 +284,159 @@ double sparsehash_sim_J(const char *sketch_1, const char *sketch_2, uint32_t bit
 // Compute Hamming distance between two sketches
 uint32_t sparsehash_dist_H(const char *sketch_1, const char *sketch_2, uint32_t bit_len);
 
+// Hamming distance if at most max_dist, otherwise some value above max_dist. Stops counting at the first 256-byte
+// block taking it above max_dist, so far pairs cost a fraction of sparsehash_dist_H
+uint32_t sparsehash_dist_H_bounded(const char *sketch_1, const char *sketch_2, uint32_t bit_len, uint32_t max_dist);
+
+// sparsehash_dist_H_bounded of sketch against num_sketches contiguous sketches, in out
+void sparsehash_dist_H_bounded_many(const char *sketch, const char *sketches, uint32_t num_sketches, uint32_t bit_len, uint32_t max_dist, uint32_t *out);
+
+// All-pairs comparison of num_sketches sketches of bit_len bits stored contiguously, (bit_len+7)/8 bytes each.
+// Entries are the upper triangle in row order: row i holds sketch i against sketches i+1 to num_sketches-1.
+// Jaccard entries agree with sparsehash_sim_J up to rounding, Hamming entries are exact
+
+// Packed upper triangle in matrix, num_sketches*(num_sketches-1)/2 entries. 0 if successful, -1 otherwise
+int sparsehash_allpairs(const char *sketches, uint32_t num_sketches, uint32_t bit_len, sparsehash_measure_t measure, double *matrix);
+
+// Same entries written to fp as doubles, only a block of rows is held in memory. 0 if successful, -1 otherwise
+int sparsehash_allpairs_write(const char *sketches, uint32_t num_sketches, uint32_t bit_len, sparsehash_measure_t measure, FILE *fp);
+
+// Pairs with Jaccard at least threshold (Hamming at most threshold) written to fp as sparsehash_pair_t,
+// in row order. Number of pairs, -1 if failed
+int64_t sparsehash_allpairs_threshold(const char *sketches, uint32_t num_sketches, uint32_t bit_len, sparsehash_measure_t measure, double threshold, FILE *fp);
+
+// k nearest neighbours of each of num_queries queries in a collection of num_sketches sketches, both stored
+// contiguously like sparsehash_allpairs. Neighbours are ranked by Hamming distance, ties by index, and stored
+// k per query in out. Queries are scanned in batches, so every stored sketch is read once per batch.
+// Entries past the end of a short collection have index UINT32_MAX. 0 if successful, -1 otherwise
+int sparsehash_topk(const char *sketches, uint32_t num_sketches, const char *queries, uint32_t num_queries, uint32_t bit_len, uint32_t k, sparsehash_neighbor_t *out);
+
+// Banded LSH index: the m-bit sketch is split in bands of rows bits taken bands apart, sketches colliding in some band are
+// candidates. Stored sketches are copied for the verification with sparsehash_sim_J. Queries are
+// read-only and can run concurrently, not together with inserts
+typedef struct{
+
+	uint32_t m;
+	uint32_t mbytes;
+	uint32_t bands;
+	uint32_t rows;
+	uint32_t num_sketches;
+	uint32_t capacity;
+	char *sketches;			// copies of the inserted sketches, in insertion order
+	uint64_t *keys;			// band values, bands per sketch
+	uint32_t *next;			// next sketch in the bucket chain, bands per sketch
+	uint32_t table_bits;
+	uint32_t *head;			// first sketch of each of the 2^table_bits buckets of every band
+
+} sparsehash_lsh_t;
+
+// Bands and rows of an index for Jaccard threshold, minimizing the false positive and false negative
+// areas of the collision curve. Assumes sketches of m bits with get_gamma and sets of similar size. 0 if successful, -1 otherwise
+int sparsehash_lsh_params(double threshold, uint32_t m, uint32_t *bands, uint32_t *rows);
+
+// Empty index for sketches of m bits, NULL if bands*rows > m or rows > 64
+sparsehash_lsh_t* sparsehash_lsh_create(uint32_t m, uint32_t bands, uint32_t rows);
+
+void sparsehash_lsh_destroy(sparsehash_lsh_t *lsh);
+
+// Add num_sketches contiguous sketches, one or a whole collection. Index of the first one, -1 if failed
+int64_t sparsehash_lsh_insert(sparsehash_lsh_t *lsh, const char *sketches, uint32_t num_sketches);
+
+// Stored sketches colliding with sketch in some band and with Jaccard estimate at least threshold, sorted by
+// Hamming distance. *out is allocated with malloc and freed by the caller. Number of neighbours, -1 if failed
+int64_t sparsehash_lsh_query(const sparsehash_lsh_t *lsh, const char *sketch, double threshold, sparsehash_neighbor_t **out);
+
+// Multi-index hashing on the tables of the LSH index, with substrings bands covering every bit. Sketches are added
+// with sparsehash_lsh_insert and the index is freed with sparsehash_lsh_destroy
+typedef sparsehash_lsh_t sparsehash_mih_t;
+
+// Number of substrings for num_sketches sketches of m bits, about log2(num_sketches) bits each
+uint32_t sparsehash_mih_substrings(uint32_t m, uint32_t num_sketches);
+
+// Empty index for sketches of m bits, NULL if substrings are over 64 bits
+sparsehash_mih_t* sparsehash_mih_create(uint32_t m, uint32_t substrings);
+
+// Every stored sketch within Hamming distance radius of sketch, exactly, sorted by distance. Only the values
+// within radius/substrings of each query substring are looked up. *out is allocated with malloc and freed
+// by the caller. Number of neighbours, -1 if failed
+int64_t sparsehash_mih_query(const sparsehash_mih_t *mih, const char *sketch, uint32_t radius, sparsehash_neighbor_t **out);
+
+// Sketches compared on growing prefixes. Bits are stored in prefix order, measurement i at the rank of the bit-reversal
+// of i, so that every prefix samples measurements from the whole hash range rather than neighbouring, overlapping
+// intervals. Popcounts, hence sparsehash_sim_J and sparsehash_dist_H, do not depend on the order
+typedef struct{
+
+	uint32_t m;
+	uint32_t mbytes;
+	uint32_t prefix_bytes;
+	uint32_t num_sketches;
+	char *prefix;			// first prefix_bytes of every sketch, contiguous
+	char *suffix;			// remaining mbytes-prefix_bytes of every sketch
+
+} sparsehash_cascade_t;
+
+// Copy sketch of m bits to out in prefix order
+void sparsehash_prefix_order(const char *sketch, uint32_t m, char *out);
+
+// Jaccard estimate of two sketches in prefix order, computed on prefix_bits (rounded to bytes) and then on 4 times more
+// bits until the whole sketch, stopping as soon as the upper confidence bound of the estimate, confidence standard
+// deviations above it, is below threshold. 1 and the estimate of sparsehash_sim_J in *sim if all the bits were compared,
+// 0 and the estimate of the last prefix if rejected. prefix_bits 0 is m/16, at least 512. threshold 0 or below never rejects
+int sparsehash_sim_J_cascade(const char *sketch_1, const char *sketch_2, uint32_t bit_len, uint32_t prefix_bits, double threshold, double confidence, double *sim);
+
+// Collection of num_sketches contiguous sketches of m bits, reordered with prefixes of prefix_bits (as
+// sparsehash_sim_J_cascade) stored apart. NULL if out of memory
+sparsehash_cascade_t* sparsehash_cascade_create(const char *sketches, uint32_t num_sketches, uint32_t m, uint32_t prefix_bits);
+
+void sparsehash_cascade_destroy(sparsehash_cascade_t *cascade);
+
+// Sketches with Jaccard estimate at least threshold with sketch (in natural order), rejecting candidates on their prefixes
+// as sparsehash_sim_J_cascade; every sketch if threshold is 0 or below, even with a negative estimate. Sorted by Hamming distance, *out is allocated with malloc and freed by the caller.
+// Number of neighbours, -1 if failed
+int64_t sparsehash_cascade_query(const sparsehash_cascade_t *cascade, const char *sketch, double threshold, double confidence, sparsehash_neighbor_t **out);
+
+// Phases timed by the instrumentation, in seconds of the thread running them
+typedef enum{
+
+	SPARSEHASH_PHASE_PLAN_INTERVALS,	// interval bottoms or seeds of the exact version from the generator
+	SPARSEHASH_PHASE_PLAN_SORT,		// qsort of the bottoms
+	SPARSEHASH_PHASE_PLAN_LOOKUP,		// search structure of sparsehash_plan_set_lookup
+	SPARSEHASH_PHASE_HASH,			// hashes of the elements, with the comparisons of the exact version
+	SPARSEHASH_PHASE_LOOKUP,		// hashes against the intervals, medium and fast versions
+	SPARSEHASH_NUM_PHASES
+
+} sparsehash_phase_t;
+
+// Counters of the calls made by one thread since the last sparsehash_stats_reset, including the work of the
+// OpenMP threads it started. Only collected when built with -DSPARSEHASH_STATS (make STATS=1), zero otherwise
+typedef struct{
+
+	double phase_seconds[SPARSEHASH_NUM_PHASES];
+	uint64_t calls;			// sketches and updates, every chunk of sparsehash_sketch_batch
+	uint64_t elements;
+	uint64_t hashes;		// hash evaluations, one per element and measurement reached by the exact version
+	uint64_t searches;		// hashes looked up by the fast version
+	uint64_t nodes_visited;		// tree, array, bucket or Eytzinger steps of the searches, intervals passed by the sweep
+	uint64_t hits;			// searches ending in an interval
+	uint64_t overlap_scanned;	// overlapping intervals set by the left and right scans after the hits
+	uint64_t windows;		// interval tests against tiles of hashes of the medium version
+	uint64_t bits_set;		// sketch bits turned from 0 to 1 by each call, chunks of a split set count separately
+
+} sparsehash_stats_t;
+
+// Nonzero if the library was built with the instrumentation
+int sparsehash_stats_enabled(void);
+
+// Copy the counters of the calling thread
+void sparsehash_stats_get(sparsehash_stats_t *stats);
+
+// Zero the counters of the calling thread
+void sparsehash_stats_reset(void);
+
+// Add the counters of src to dst, to aggregate the threads of the caller
+void sparsehash_stats_add(sparsehash_stats_t *dst, const sparsehash_stats_t *src);
+
 // Compute gamma that maximizes the entropy of the sketch
-double get_gamma(uint32_t sparsity);
\ No newline at end of file
+double get_gamma(uint32_t sparsity);
+
+#endif // _SPARSEHASH_H_
@@ -0,0 +1,79 @@
+#include "stats.h"
+#include <time.h>
+
+
+#ifdef SPARSEHASH_STATS
+
+__thread sparsehash_stats_t sparsehash_thread_stats;
+
+
+double stats_now(void){
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+
+}
+
+
+void stats_fold(sparsehash_stats_t *acc){
+
+	#pragma omp critical(sparsehash_stats)
+	sparsehash_stats_add(acc, &sparsehash_thread_stats);
+
+	memset(&sparsehash_thread_stats, 0, sizeof(sparsehash_stats_t));
+
+}
+
+#endif
+
+
+int sparsehash_stats_enabled(void){
+
+#ifdef SPARSEHASH_STATS
+	return 1;
+#else
+	return 0;
+#endif
+
+}
+
+
+void sparsehash_stats_get(sparsehash_stats_t *stats){
+
+#ifdef SPARSEHASH_STATS
+	memcpy(stats, &sparsehash_thread_stats, sizeof(sparsehash_stats_t));
+#else
+	memset(stats, 0, sizeof(sparsehash_stats_t));
+#endif
+
+}
+
+
+void sparsehash_stats_reset(void){
+
+#ifdef SPARSEHASH_STATS
+	memset(&sparsehash_thread_stats, 0, sizeof(sparsehash_stats_t));
+#endif
+
+}
+
+
+void sparsehash_stats_add(sparsehash_stats_t *dst, const sparsehash_stats_t *src){
+
+	uint32_t p;
+
+
+	for (p=0; p<SPARSEHASH_NUM_PHASES; ++p)
+		dst->phase_seconds[p] += src->phase_seconds[p];
+	dst->calls += src->calls;
+	dst->elements += src->elements;
+	dst->hashes += src->hashes;
+	dst->searches += src->searches;
+	dst->nodes_visited += src->nodes_visited;
+	dst->hits += src->hits;
+	dst->overlap_scanned += src->overlap_scanned;
+	dst->windows += src->windows;
+	dst->bits_set += src->bits_set;
+
+}
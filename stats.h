@@ -0,0 +1,40 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include "sparsehash.h"
+
+
+// Instrumentation of the hot paths, compiled out unless built with -DSPARSEHASH_STATS. Counters go to the
+// stats of the running thread. Threads of a parallel region move theirs into an accumulator of the caller,
+// declared with STATS_CALLER before the region and added to the caller's stats with STATS_JOIN after it
+#ifdef SPARSEHASH_STATS
+
+extern __thread sparsehash_stats_t sparsehash_thread_stats;
+
+// Monotonic clock in seconds
+double stats_now(void);
+
+// Move the counters of the running thread into acc
+void stats_fold(sparsehash_stats_t *acc);
+
+#define STATS_ONLY(x) x
+#define STATS_ADD(field, n) (sparsehash_thread_stats.field += (n))
+#define STATS_START(t) double t = stats_now()
+#define STATS_STOP(phase, t) (sparsehash_thread_stats.phase_seconds[phase] += stats_now() - (t))
+#define STATS_CALLER(acc) sparsehash_stats_t acc; memset(&acc, 0, sizeof(acc))
+#define STATS_FOLD(acc) stats_fold(&acc)
+#define STATS_JOIN(acc) sparsehash_stats_add(&sparsehash_thread_stats, &acc)
+
+#else
+
+#define STATS_ONLY(x)
+#define STATS_ADD(field, n) ((void)0)
+#define STATS_START(t)
+#define STATS_STOP(phase, t) ((void)0)
+#define STATS_CALLER(acc)
+#define STATS_FOLD(acc) ((void)0)
+#define STATS_JOIN(acc) ((void)0)
+
+#endif
+
+#endif // _STATS_H_
@@ -0,0 +1,166 @@
+#include "sparsehash.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+// Bytes of the queries of a batch and of the sketches of a tile, both stay in L2 while the tile is scanned
+#define TOPK_BATCH_BYTES 131072
+#define TOPK_TILE_BYTES 131072
+
+// Most queries in a batch, bounds the heaps kept by every thread
+#define TOPK_BATCH_MAX 256
+
+
+// Heap entries pack the distance over the index, so that ties are broken by the lower index
+#define TOPK_KEY(dist, index) ( ((uint64_t)(dist) << 32) | (index) )
+
+
+// Push key in the max-heap of k entries holding size of them, the largest key is dropped when full
+static inline void topk_push(uint64_t *heap, uint32_t *size, uint32_t k, uint64_t key){
+
+	uint32_t i, child;
+
+
+	if (*size < k){
+		// Sift up
+		i = (*size)++;
+		while (i > 0 && heap[(i-1)/2] < key){
+			heap[i] = heap[(i-1)/2];
+			i = (i-1)/2;
+		}
+		heap[i] = key;
+		return;
+	}
+
+	if (key >= heap[0])
+		return;
+
+	// Replace the root and sift down
+	i = 0;
+	while ( (child = 2*i+1) < k ){
+		if (child+1 < k && heap[child+1] > heap[child])
+			child++;
+		if (heap[child] <= key)
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = key;
+
+}
+
+
+static int cmpkey(const void *a, const void *b){
+
+	uint64_t ka = *(const uint64_t*)a, kb = *(const uint64_t*)b;
+	return (ka > kb) - (ka < kb);
+
+}
+
+
+int sparsehash_topk(const char *sketches, uint32_t num_sketches, const char *queries, uint32_t num_queries, uint32_t bit_len, uint32_t k, sparsehash_neighbor_t *out){
+
+	uint32_t stride, batch, tile, first, last, q, r;
+	uint64_t *heaps;
+	uint32_t *sizes;
+	int failed = 0;
+
+
+	if (k == 0 || num_queries == 0)
+		return 0;
+
+	stride = (bit_len+7)/8;
+	batch = TOPK_BATCH_BYTES/stride;
+	if (batch > TOPK_BATCH_MAX)
+		batch = TOPK_BATCH_MAX;
+	if (batch == 0)
+		batch = 1;
+	tile = TOPK_TILE_BYTES/stride;
+	if (tile == 0)
+		tile = 1;
+
+	heaps = (uint64_t*) malloc(sizeof(uint64_t)*batch*k);
+	sizes = (uint32_t*) malloc(sizeof(uint32_t)*batch);
+	if (heaps == NULL || sizes == NULL){
+		free(heaps);
+		free(sizes);
+		return -1;
+	}
+
+	for (first=0; first<num_queries; first=last){
+
+		last = (num_queries-first > batch) ? first+batch : num_queries;
+		memset(sizes, 0, sizeof(uint32_t)*batch);
+
+		// Every thread scans its share of the collection for the whole batch, then merges its heaps
+		#pragma omp parallel private(q, r)
+		{
+
+			uint32_t t = 0, num_threads = 1, s, tile_first, tile_last, chunk_first, chunk_last;
+			uint64_t *local = (uint64_t*) malloc(sizeof(uint64_t)*(last-first)*k);
+			uint32_t *local_sizes = (uint32_t*) calloc(last-first, sizeof(uint32_t));
+
+#ifdef _OPENMP
+			t = omp_get_thread_num();
+			num_threads = omp_get_num_threads();
+#endif
+			chunk_first = (uint32_t)((uint64_t)num_sketches*t/num_threads);
+			chunk_last = (uint32_t)((uint64_t)num_sketches*(t+1)/num_threads);
+
+			if (local == NULL || local_sizes == NULL){
+				#pragma omp atomic write
+				failed = 1;
+			}
+			else{
+				for (tile_first=chunk_first; tile_first<chunk_last; tile_first=tile_last){
+					tile_last = (chunk_last-tile_first > tile) ? tile_first+tile : chunk_last;
+					for (q=first; q<last; ++q){
+						for (s=tile_first; s<tile_last; ++s)
+							topk_push(local + (size_t)(q-first)*k, local_sizes+(q-first), k,
+									  TOPK_KEY(sparsehash_dist_H(queries + (size_t)q*stride, sketches + (size_t)s*stride, bit_len), s));
+					}
+				}
+
+				#pragma omp critical
+				for (q=0; q<last-first; ++q){
+					for (r=0; r<local_sizes[q]; ++r)
+						topk_push(heaps + (size_t)q*k, sizes+q, k, local[(size_t)q*k+r]);
+				}
+			}
+
+			free(local);
+			free(local_sizes);
+
+		}
+
+		if (failed)
+			break;
+
+		// Only the winners get a Jaccard estimate
+		for (q=first; q<last; ++q){
+			uint64_t *heap = heaps + (size_t)(q-first)*k;
+			sparsehash_neighbor_t *nn = out + (size_t)q*k;
+			qsort(heap, sizes[q-first], sizeof(uint64_t), cmpkey);
+			for (r=0; r<k; ++r){
+				if (r < sizes[q-first]){
+					nn[r].index = (uint32_t)heap[r];
+					nn[r].dist = (uint32_t)(heap[r] >> 32);
+					nn[r].sim = sparsehash_sim_J(queries + (size_t)q*stride, sketches + (size_t)nn[r].index*stride, bit_len);
+				}
+				else{
+					nn[r].index = UINT32_MAX;
+					nn[r].dist = UINT32_MAX;
+					nn[r].sim = NAN;
+				}
+			}
+		}
+
+	}
+
+	free(heaps);
+	free(sizes);
+
+	return failed ? -1 : 0;
+
+}
@@ -4,8 +4,9 @@ static void fillValues(bst_t *botTree, const uint64_t botVal, const uint64_t tau
 
 	botTree->botVal = botVal;
 	
+	// Clip at the end of the hash range
 	if (botVal > UINT64_MAX-tau)
-		botTree->topVal = tau-(UINT64_MAX-botVal);
+		botTree->topVal = UINT64_MAX;
 	else
 		botTree->topVal = botVal + tau;
 
@@ -61,4 +62,112 @@ bst_t* buildTree(const uint64_t *bot, const uint32_t m, const uint64_t tau, bst_
 
 	return head;
 
-}
\ No newline at end of file
+}
+
+
+// In-order visit of the implicit tree, i is the next sorted extreme to place
+static uint32_t fillEytzinger(uint32_t i, uint32_t k, const uint64_t *bot, const uint32_t m, uint64_t *eytz, uint32_t *idx){
+
+	if (k <= m){
+		i = fillEytzinger(i, 2*k, bot, m, eytz, idx);
+		eytz[k] = bot[i];
+		idx[k] = i;
+		i = fillEytzinger(i+1, 2*k+1, bot, m, eytz, idx);
+	}
+
+	return i;
+
+}
+
+
+// Lay out the sorted extremes in Eytzinger order
+void buildEytzinger(const uint64_t *bot, const uint32_t m, uint64_t *eytz, uint32_t *idx){
+
+	eytz[0] = 0;
+	idx[0] = m;
+
+	fillEytzinger(0, 1, bot, m, eytz, idx);
+
+}
+
+
+// Split the hash range in buckets, one pass over the sorted extremes
+void buildBuckets(const uint64_t *bot, const uint32_t m, const uint32_t bits, uint32_t *first){
+
+	uint64_t b, nbuckets;
+	uint32_t i = 0;
+
+
+	nbuckets = (uint64_t)1 << bits;
+
+	for (b=0; b<nbuckets; ++b){
+		while (i<m && (bot[i] >> (64-bits)) < b)
+			i++;
+		first[b] = i;
+	}
+	first[nbuckets] = m;
+
+}
+
+
+// LSD radix sort, 8 bits per pass. Passes where all keys have the same digit are skipped,
+// which is common for the top digits when n is small and for inputs with many duplicates
+uint64_t* radixSort(uint64_t *keys, uint64_t *tmp, const uint32_t n){
+
+	uint32_t count[8][256];
+	uint32_t i, d, sum, c;
+	uint64_t *src = keys, *dst = tmp, *swap;
+
+
+	memset(count, 0, sizeof(count));
+
+	// Histograms of all the digits in one pass
+	for (i=0; i<n; ++i){
+		for (d=0; d<8; ++d)
+			count[d][(keys[i] >> (8*d)) & 0xFF]++;
+	}
+
+	for (d=0; d<8; ++d){
+
+		if (n == 0 || count[d][(keys[0] >> (8*d)) & 0xFF] == n)
+			continue;
+
+		// Starting position of each digit
+		sum = 0;
+		for (i=0; i<256; ++i){
+			c = count[d][i];
+			count[d][i] = sum;
+			sum += c;
+		}
+
+		for (i=0; i<n; ++i)
+			dst[count[d][(src[i] >> (8*d)) & 0xFF]++] = src[i];
+
+		swap = src;
+		src = dst;
+		dst = swap;
+
+	}
+
+	return src;
+
+}
+
+
+// Remove the duplicates of sorted keys
+uint32_t uniqueSorted(uint64_t *keys, const uint32_t n){
+
+	uint32_t i, u;
+
+
+	if (n == 0)
+		return 0;
+
+	for (i=1, u=1; i<n; ++i){
+		if (keys[i] != keys[u-1])
+			keys[u++] = keys[i];
+	}
+
+	return u;
+
+}
@@ -1,3 +1,6 @@
+#ifndef _UTILS_H_
+#define _UTILS_H_
+
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
@@ -14,4 +17,20 @@ typedef struct bst{
 
 
 // Build a BST from the sorted extremes, return head of tree
-bst_t* buildTree(const uint64_t *bot, const uint32_t m, const uint64_t tau, bst_t *botTree);
\ No newline at end of file
+bst_t* buildTree(const uint64_t *bot, const uint32_t m, const uint64_t tau, bst_t *botTree);
+
+// Lay out the sorted extremes in Eytzinger order: 1-based, children of k are 2k and 2k+1.
+// eytz and idx hold m+1 entries, idx[k] is the position of eytz[k] in bot
+void buildEytzinger(const uint64_t *bot, const uint32_t m, uint64_t *eytz, uint32_t *idx);
+
+// Split the hash range in 2^bits buckets by the top bits, first[b] is the first extreme in bucket b or above.
+// first holds 2^bits+1 entries, the last one is m
+void buildBuckets(const uint64_t *bot, const uint32_t m, const uint32_t bits, uint32_t *first);
+
+// LSD radix sort of n keys using tmp (n entries) as second buffer, returns the one holding the sorted keys
+uint64_t* radixSort(uint64_t *keys, uint64_t *tmp, const uint32_t n);
+
+// Remove the duplicates of n sorted keys in place, return the number of distinct keys
+uint32_t uniqueSorted(uint64_t *keys, const uint32_t n);
+
+#endif // _UTILS_H_